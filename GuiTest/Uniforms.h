@@ -226,11 +226,11 @@ struct CameraData {
     alignas(16) glm::vec3 camera_rot;
     alignas(16) glm::vec3 light_pos;
     alignas(16) glm::vec4 data1;
-    alignas(16) glm::vec4 data2;
+    alignas(16) glm::vec4 data2; //data2.x: Over Relaxation
     alignas(16) glm::vec4 data3; //data.w: fog density
     alignas(16) glm::vec4 data4; //data4.x: FOV, data4.y: Player Speed, data4.z: Normal Offset, data4.w: timeMultiplier
     alignas(8) glm::vec2 resolution;
-    alignas(4) glm::int32 int1;
+    alignas(4) glm::int32 int1; //Hit Refinement Steps
     alignas(4) glm::int32 int2;
     alignas(4) glm::int32 int3;
     alignas(4) glm::int32 int4;
@@ -321,6 +321,78 @@ struct WorldObjectsData_v0_1_2 {
 
 #endif // !WORLD_DATA_H
 
+#ifndef WORLD_BVH_H
+#define WORLD_BVH_H
+
+struct WorldBVHNode {
+    alignas(16) glm::vec4 boundsMin;
+    alignas(16) glm::vec4 boundsMax;
+    alignas(4) glm::int32 left;
+    alignas(4) glm::int32 right;
+    alignas(4) glm::int32 index; // World index for leaves, -1 for inner nodes
+    alignas(4) glm::int32 padding;
+};
+
+struct WorldBVHData {
+    alignas(4) glm::int32 num_nodes;
+    alignas(4) glm::int32 num_unbounded;
+    alignas(16) glm::ivec4 unbounded[MAX_OBJECTS / 4]; // Packed 4 per element to match the std140 array stride
+    alignas(16) WorldBVHNode nodes[MAX_OBJECTS * 2];
+};
+
+// map_the_world_new's traversal stack holds one far child per level plus the near one, and the median split is at
+// most ceil(log2(MAX_OBJECTS)) levels deep, so the shader never has to drop a subtree
+#define WORLD_BVH_STACK_SIZE 16 // Has to match BVH_STACK_SIZE
+static_assert(MAX_OBJECTS <= (1 << (WORLD_BVH_STACK_SIZE - 1)), "the world BVH can get deeper than the shader's traversal stack");
+
+#endif // !WORLD_BVH_H
+
+#ifndef RAYMARCH_SPECIALIZATION_H
+#define RAYMARCH_SPECIALIZATION_H
+
+// Specialization constants of shader.frag, constant_id 0-2 in order
+struct RaymarchSpecialization {
+    glm::int32 chainStackSize;
+    glm::int32 imageCount;
+    glm::int32 maxIterCount;
+
+    bool operator==(const RaymarchSpecialization& other) const {
+        return chainStackSize == other.chainStackSize && imageCount == other.imageCount && maxIterCount == other.maxIterCount;
+    }
+};
+
+#endif // !RAYMARCH_SPECIALIZATION_H
+
+#ifndef COMPOSITE_CONSTANTS_H
+#define COMPOSITE_CONSTANTS_H
+
+// Push constants of composite.frag
+struct CompositeConstants {
+    alignas(8) glm::vec2 renderSize;
+    alignas(8) glm::vec2 targetSize;
+    alignas(4) glm::int32 edgeAware;
+};
+
+#endif // !COMPOSITE_CONSTANTS_H
+
+#ifndef RAYMARCH_CONSTANTS_H
+#define RAYMARCH_CONSTANTS_H
+
+// Push constants of the compute backend
+struct RaymarchConstants {
+    alignas(16) glm::vec4 prevCameraPos;        // w: previous FOV
+    alignas(16) glm::vec4 prevCameraRot;
+    alignas(8) glm::vec2 jitter;                // Sub pixel offset of this sample
+    alignas(4) glm::int32 sampleIndex;          // 0 restarts the history
+    alignas(4) glm::int32 pass;                 // 0 every pixel, 1 and 2 the checkerboard halves, 3 edge supersampling, 4 depth splat, 5-8 deferred
+    alignas(4) glm::int32 frameParity;
+    alignas(8) glm::ivec2 tileOffset;           // First pixel of the dispatch, a progressive tile run or the uncovered part
+    alignas(4) glm::int32 shadowsOff;           // 1 for the interaction preview tier
+    alignas(4) glm::int32 seedDepth;            // 1 when the primary rays start from the last frame's splatted depth
+};
+
+#endif // !RAYMARCH_CONSTANTS_H
+
 #ifndef ANIMATION_DATA_H
 #define ANIMATION_DATA_H
 
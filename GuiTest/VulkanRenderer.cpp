@@ -1108,6 +1108,10 @@ void imguiWindow::drawObject(int i, int depth, std::string prefix, int* keys) {
         if (ImGui::IsItemHovered()) ImGui::SetTooltip("The type of the object, select a type to see its settings");
         ImGui::SliderInt("Bump Map Index", &saveData->worldData.objects[i].int3, 0, MAX_IMAGES - 1);
         if (ImGui::IsItemHovered()) ImGui::SetTooltip("The texture index of the bump map, setting to 0 will use no bump map");
+        if (saveData->worldData.objects[i].int3 != 0) {
+            ImGui::SliderInt("Bump Map Mode", &saveData->worldData.objects[i].int5, 0, 1);
+            if (ImGui::IsItemHovered()) ImGui::SetTooltip("0 displaces the surface while marching, 1 only bends the lighting at the hit point which is much faster");
+        }
         ImGui::SliderInt("Texture Index", &saveData->worldData.objects[i].textureIndex, 0, MAX_IMAGES - 1);
         if (ImGui::IsItemHovered()) ImGui::SetTooltip("The texture index of the object, setting to 0 will allow for solid color");
         if (saveData->worldData.objects[i].textureIndex != 0 || saveData->worldData.objects[i].int3 != 0) {
@@ -1138,7 +1142,7 @@ void imguiWindow::drawObject(int i, int depth, std::string prefix, int* keys) {
         //ImGui::SliderInt("Is Negated?", &saveData->worldData.objects[i].is_negated, 0, 1);
         //createPlayPopup1I("worldData objects " + std::to_string(i) + " is_negated", &saveData->worldData.objects[i].is_negated, "Is Negated?");
         ImGui::DragFloat("Shadow Blur", &saveData->worldData.objects[i].shadow_blur, 0.1, -0.1, 20);
-        if (ImGui::IsItemHovered()) ImGui::SetTooltip("How sharp the shadow is, negative number means no shadow");
+        if (ImGui::IsItemHovered()) ImGui::SetTooltip("How sharp the shadow's penumbra is, higher is sharper, negative number means no shadow");
         createPlayPopup1F("worldData objects " + std::to_string(i) + " shadow_blur", &saveData->worldData.objects[i].shadow_blur, "Has Shadow?");
         if (saveData->worldData.objects[i].shadow_blur >= 0.0f) {
             ImGui::DragFloat("Shadow Intensity", &saveData->worldData.objects[i].shadow_intensity, 0.001, 0, 1);
@@ -1735,7 +1739,10 @@ void imguiWindow::drawWindow() {
     //ImGui::SetNextWindowSize(ImVec2(staticWidth, dynamicHeight), ImGuiCond_Always);
     //ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Always);
 
+    // Opaque so the renderer can skip the pixels under it
+    ImGui::SetNextWindowBgAlpha(1.0f);
     ImGui::Begin("World Builder", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+    vkRenderer->markOpaqueWindow();
     
     ImGui::PushItemWidth(200.0f);
 
@@ -1926,6 +1933,64 @@ void imguiWindow::drawWindow() {
                 }
             }
 
+            if (ImGui::CollapsingHeader("Renderer")) {
+                ImGui::Checkbox("Cone Prepass", &vkRenderer->settings.conePrepass);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Finds the empty space in front of the camera at a low resolution first so rays can skip it");
+                ImGui::Checkbox("Compute Backend", &vkRenderer->settings.computeBackend);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Ray march in a compute shader instead of the fragment shader. Turn off if the compute shader doesn't work on this GPU");
+                ImGui::Checkbox("Dynamic Resolution", &vkRenderer->settings.dynamicResolution);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Lowers the resolution when a frame takes longer than the target frame time. Only works with the compute backend");
+                ImGui::DragFloat("Target Frame Time", &vkRenderer->settings.targetFrameTime, 0.1f, 1.0f, 100.0f, "%.1f ms");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("How long the GPU should take per frame, 16.6 ms is 60 FPS");
+                ImGui::SliderFloat("Min Resolution Scale", &vkRenderer->settings.minRenderScale, 0.1f, 1.0f);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("The lowest the resolution can go, as a fraction of the window size");
+                ImGui::Checkbox("Edge Aware Upscale", &vkRenderer->settings.edgeAwareUpscale);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Keeps edges sharp when scaling a lower resolution up instead of blurring them");
+                ImGui::Text("Resolution Scale: %.2f, GPU Frame Time: %.2f ms", vkRenderer->stats.renderScale, vkRenderer->stats.gpuFrameTime);
+                ImGui::Checkbox("Temporal Accumulation", &vkRenderer->settings.temporalAccumulation);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Averages jittered samples while nothing changes, anti-aliasing the still image. Only works with the compute backend");
+                ImGui::SliderInt("Max Accumulated Samples", &vkRenderer->settings.maxAccumulatedSamples, 1, 1024);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Stops ray marching once this many samples have been averaged");
+                ImGui::Text("Accumulated Samples: %d", vkRenderer->stats.accumulatedSamples);
+                ImGui::Checkbox("Render On Demand", &vkRenderer->settings.renderOnDemand);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Stops drawing while nothing changes instead of redrawing the same image every frame");
+                ImGui::Checkbox("Checkerboard", &vkRenderer->settings.checkerboard);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Ray marches half the pixels each frame and reprojects the other half from the last frame. Only works with the compute backend");
+                ImGui::Checkbox("Reproject Depth", &vkRenderer->settings.reprojectDepth);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Starts each pixel's ray close to where the last frame hit, so rays take fewer steps while only the camera moves. Only works with the compute backend");
+                ImGui::Checkbox("Deferred Shading", &vkRenderer->settings.deferredShading);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Ray marches to a G-buffer first and then textures and lights, shadows and reflects or refracts in separate passes. Only works with the compute backend");
+                ImGui::Checkbox("Edge Supersampling", &vkRenderer->settings.edgeSupersampling);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Anti-aliases by marching four more rays for the pixels on an edge. Only works with the compute backend");
+                ImGui::SliderInt("Frames In Flight", &vkRenderer->settings.framesInFlight, 1, MAX_FRAMES_IN_FLIGHT);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("How many frames the CPU can get ahead of the GPU. More is smoother when the CPU is the slow part, fewer has less input lag");
+                ImGui::Checkbox("Late Latch Camera", &vkRenderer->settings.lateLatchCamera);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Reads the mouse again right before the frame is sent to the GPU so looking around lags less");
+                ImGui::Combo("Present Mode", &vkRenderer->settings.presentMode, "FIFO (V-Sync)\0Mailbox\0Immediate\0");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("FIFO waits for the display, Mailbox replaces the waiting frame with newer ones, Immediate can tear. Falls back to FIFO when the display doesn't have it");
+                ImGui::DragFloat("Frame Rate Limit", &vkRenderer->settings.frameRateLimit, 1.0f, 0.0f, 1000.0f, vkRenderer->settings.frameRateLimit > 0.0f ? "%.0f FPS" : "Uncapped");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Caps how many frames the CPU starts per second, saves power with Mailbox or Immediate. 0 is uncapped");
+                ImGui::Checkbox("Interaction Preview", &vkRenderer->settings.interactionPreview);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Draws at a lower quality while moving or dragging a value and goes back to full quality once it stops");
+                ImGui::SliderFloat("Preview Resolution Scale", &vkRenderer->settings.previewRenderScale, 0.1f, 1.0f);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Resolution while previewing, as a fraction of the normal one. Only works with the compute backend");
+                ImGui::SliderInt("Preview Steps", &vkRenderer->settings.previewSteps, 1, 1024);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("The most ray march steps while previewing");
+                ImGui::Checkbox("Skip Covered Pixels", &vkRenderer->settings.skipCoveredPixels);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Doesn't ray march the part of the screen behind this panel");
+                ImGui::Checkbox("Progressive Tiles", &vkRenderer->settings.progressiveTiles);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Ray marches the screen a few tiles per frame so the UI stays responsive on heavy worlds, the image fills in over a few frames. Only works with the compute backend");
+                ImGui::DragFloat("Tile Budget", &vkRenderer->settings.tileBudget, 0.1f, 1.0f, 100.0f, "%.1f ms");
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("How much GPU time per frame goes to the tiles");
+                if (vkRenderer->settings.progressiveTiles) {
+                    ImGui::Text("Tiles: %d / %d", vkRenderer->stats.progressiveTilesDone, vkRenderer->stats.progressiveTileCount);
+                }
+                ImGui::Text("FPS: %.1f, CPU Frame Time: %.2f ms", vkRenderer->stats.frameRate, vkRenderer->stats.cpuFrameTime);
+                if (vkRenderer->stats.refreshInterval > 0.0f) {
+                    ImGui::Text("Present Interval: %.2f ms, Refresh: %.2f ms", vkRenderer->stats.presentInterval, vkRenderer->stats.refreshInterval);
+                }
+            }
+
             if (ImGui::CollapsingHeader("Camera Data")) {
 
                 ImGui::DragFloat3("Camera Pos", &saveData->camData.camera_pos[0], 0.1f);
@@ -1943,6 +2008,12 @@ void imguiWindow::drawWindow() {
                 ImGui::DragFloat("Min Step", &saveData->camData.min_step, 0.00001f, 0.00001f, .1f, "%.5f");
                 if (ImGui::IsItemHovered()) ImGui::SetTooltip("The distance from a surface that is considered a hit");
                 createPlayPopup1F("camData min_step", &saveData->camData.min_step, "Min Step");
+                ImGui::DragFloat("Over Relaxation", &saveData->camData.data2.x, 0.01f, 1.0f, 1.95f);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Multiplies each step by this amount and steps back when it overshoots. 1 is off, around 1.6 takes fewer steps on flat and boxy worlds");
+                createPlayPopup1F("camData data2 x", &saveData->camData.data2.x, "Over Relaxation");
+                ImGui::SliderInt("Hit Refinement Steps", &saveData->camData.int1, 0, 8);
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("Extra steps that move a hit onto the surface, lets a larger 'Min Step' still give sharp edges. 0 is off");
+                createPlayPopup1I("camData int1", &saveData->camData.int1, "Hit Refinement Steps");
                 ImGui::DragFloat("Max Dist", &saveData->camData.max_dist, 10.0f, 0.0f, 2000.0f);
                 if (ImGui::IsItemHovered()) ImGui::SetTooltip("The max distance a ray will travel");
                 createPlayPopup1F("camData max_dist", &saveData->camData.max_dist, "Max Dist");
@@ -3063,6 +3134,12 @@ void VulkanRenderer::swapTexture(const std::string& newTexturePath, size_t index
     //recordCommandBuffers();
 
     vkDeviceWaitIdle(device);
+
+    // The SaveData doesn't change with a texture, so the accumulated and on screen images have to be told
+    accumulationValid = false;
+    sceneImageValid = false;
+    progressiveValid = false;
+    requestRedraw();
 }
 
 void VulkanRenderer::updateOldSaves() {
@@ -3098,11 +3175,12 @@ void VulkanRenderer::initVulkan() {
     createSwapChain();
     createImageViews();
     createRenderPass();
+    createConePrepassRenderPass();
     createDescriptorSetLayout();
     createGraphicsPipeline();
     createCommandPool();
-    createColorResources();
-    createDepthResources();
+    createConePrepassResources();
+    createRaymarchImage();
     createFramebuffers();
     createTextureImage(INIT_SKYBOX, 0);
     createTextureImageView(0);
@@ -3119,6 +3197,7 @@ void VulkanRenderer::initVulkan() {
     createDescriptorSets();
     createCommandBuffers();
     createSyncObjects();
+    createTimestampQueries();
     swapTexture(INIT_SKYBOX, 0);
     swapTexture(TEST_TEXTURE, 1);
 }
@@ -3138,7 +3217,7 @@ void VulkanRenderer::initImgui()
     info.Device = device;
     info.PhysicalDevice = physicalDevice;
     info.ImageCount = MAX_FRAMES_IN_FLIGHT;
-    info.MsaaSamples = msaaSamples;
+    info.MsaaSamples = VK_SAMPLE_COUNT_1_BIT;
     ImGui_ImplVulkan_Init(&info);
 
     VkCommandBuffer commandBuffer = beginSingleTimeCommands();
@@ -3197,7 +3276,7 @@ void VulkanRenderer::createInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_2;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -3310,7 +3389,6 @@ void VulkanRenderer::pickPhysicalDevice() {
     for (const auto& device : devices) {
         if (isDeviceSuitable(device)) {
             physicalDevice = device;
-            msaaSamples = getMaxUsableSampleCount();
             break;
         }
     }
@@ -3334,7 +3412,19 @@ bool VulkanRenderer::isDeviceSuitable(VkPhysicalDevice device) {
     VkPhysicalDeviceFeatures supportedFeatures;
     vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+    // Frame pacing is done with a timeline semaphore
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    if (properties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &timelineFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+    }
+
+    return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy && timelineFeatures.timelineSemaphore;
 }
 
 VulkanRenderer::QueueFamilyIndices VulkanRenderer::findQueueFamilies(VkPhysicalDevice device) {
@@ -3385,6 +3475,21 @@ bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
+bool VulkanRenderer::deviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, extensionName) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 
 // Create Logical Device
 void VulkanRenderer::createLogicalDevice() {
@@ -3406,16 +3511,28 @@ void VulkanRenderer::createLogicalDevice() {
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &timelineFeatures;
 
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    // Present timing is only for the stats, the renderer works the same without it
+    std::vector<const char*> enabledExtensions = deviceExtensions;
+    displayTimingSupported = deviceExtensionAvailable(physicalDevice, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+    if (displayTimingSupported) {
+        enabledExtensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     if (enableValidationLayers) {
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -3429,6 +3546,12 @@ void VulkanRenderer::createLogicalDevice() {
         throw std::runtime_error("failed to create logical device!");
     }
 
+    if (displayTimingSupported) {
+        getPastPresentationTiming = (PFN_vkGetPastPresentationTimingGOOGLE)vkGetDeviceProcAddr(device, "vkGetPastPresentationTimingGOOGLE");
+        getRefreshCycleDuration = (PFN_vkGetRefreshCycleDurationGOOGLE)vkGetDeviceProcAddr(device, "vkGetRefreshCycleDurationGOOGLE");
+        displayTimingSupported = getPastPresentationTiming != nullptr && getRefreshCycleDuration != nullptr;
+    }
+
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
 }
@@ -3485,6 +3608,18 @@ void VulkanRenderer::createSwapChain() {
 
     swapChainImageFormat = surfaceFormat.format;
     swapChainExtent = extent;
+    swapChainPresentModeSetting = settings.presentMode;
+
+    // The past present times belong to the old swap chain
+    lastActualPresentTime = 0;
+    stats.presentInterval = 0.0f;
+    stats.refreshInterval = 0.0f;
+    if (displayTimingSupported) {
+        VkRefreshCycleDurationGOOGLE refreshCycle{};
+        if (getRefreshCycleDuration(device, swapChain, &refreshCycle) == VK_SUCCESS) {
+            stats.refreshInterval = refreshCycle.refreshDuration / 1000000.0f;
+        }
+    }
 }
 
 VulkanRenderer::SwapChainSupportDetails VulkanRenderer::querySwapChainSupport(VkPhysicalDevice device) {
@@ -3521,9 +3656,13 @@ VkSurfaceFormatKHR VulkanRenderer::chooseSwapSurfaceFormat(const std::vector<VkS
     return availableFormats[0];
 }
 
+// settings.presentMode, FIFO is the only one every surface has
 VkPresentModeKHR VulkanRenderer::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
+    const VkPresentModeKHR presentModes[] = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+    VkPresentModeKHR wanted = presentModes[std::clamp(settings.presentMode, 0, 2)];
+
     for (const auto& availablePresentMode : availablePresentModes) {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+        if (availablePresentMode == wanted) {
             return availablePresentMode;
         }
     }
@@ -3565,19 +3704,17 @@ void VulkanRenderer::recreateSwapChain() {
 
     createSwapChain();
     createImageViews();
-    createColorResources();
-    createDepthResources();
+    createConePrepassResources();
+    createRaymarchImage();
     createFramebuffers();
+
+    // The cone prepass and raymarch images are bound in the descriptor sets
+    updateDescriptorSets();
 }
 
 void VulkanRenderer::cleanupSwapChain() {
-    vkDestroyImageView(device, depthImageView, nullptr);
-    vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthImageMemory, nullptr);
-
-    vkDestroyImageView(device, colorImageView, nullptr);
-    vkDestroyImage(device, colorImage, nullptr);
-    vkFreeMemory(device, colorImageMemory, nullptr);
+    cleanupConePrepassResources();
+    cleanupRaymarchImage();
 
     for (auto framebuffer : swapChainFramebuffers) {
         vkDestroyFramebuffer(device, framebuffer, nullptr);
@@ -3603,8 +3740,39 @@ void VulkanRenderer::createImageViews() {
 
 // Create The Graphics Pipeline - I might be able to remove most of this since i am only working/mainly in the fragment shader
 void VulkanRenderer::createGraphicsPipeline() {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+
+    // The composite's in the fragment stage and the compute backend's accumulation in the compute stage
+    std::array<VkPushConstantRange, 2> pushConstantRanges{};
+    pushConstantRanges[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRanges[0].offset = 0;
+    pushConstantRanges[0].size = sizeof(CompositeConstants);
+    pushConstantRanges[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRanges[1].offset = 0;
+    pushConstantRanges[1].size = sizeof(RaymarchConstants);
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+    pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    genericFragShaderCode = readFile("frag.spv");
+    graphicsPipeline = createRaymarchPipeline(genericFragShaderCode, nullptr, renderPass);
+    conePrepassPipeline = createRaymarchPipeline(readFile("cone_frag.spv"), nullptr, conePrepassRenderPass);
+
+    genericComputeShaderCode = readFile("comp.spv");
+    computePipeline = createRaymarchComputePipeline(genericComputeShaderCode, nullptr);
+    compositePipeline = createRaymarchPipeline(readFile("composite_frag.spv"), nullptr, renderPass);
+}
+
+// Full screen raymarch pipeline around a fragment shader, shared by the generic frag.spv, the scene specialized shader
+// and the cone prepass. Without a specialization the shader's defaults (the largest sizes) are used.
+VkPipeline VulkanRenderer::createRaymarchPipeline(const std::vector<char>& fragShaderCode, const RaymarchSpecialization* specialization, VkRenderPass targetRenderPass) {
     auto vertShaderCode = readFile("vert.spv");
-    auto fragShaderCode = readFile("frag.spv");
 
     VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
     VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -3621,6 +3789,22 @@ void VulkanRenderer::createGraphicsPipeline() {
     fragShaderStageInfo.module = fragShaderModule;
     fragShaderStageInfo.pName = "main";
 
+    std::array<VkSpecializationMapEntry, 3> specializationEntries{};
+    for (uint32_t i = 0; i < specializationEntries.size(); i++) {
+        specializationEntries[i].constantID = i;
+        specializationEntries[i].offset = i * sizeof(glm::int32);
+        specializationEntries[i].size = sizeof(glm::int32);
+    }
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(RaymarchSpecialization);
+    specializationInfo.pData = specialization;
+    if (specialization != nullptr) {
+        fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+    }
+
     VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
@@ -3657,15 +3841,7 @@ void VulkanRenderer::createGraphicsPipeline() {
     VkPipelineMultisampleStateCreateInfo multisampling{};
     multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = msaaSamples;
-
-    VkPipelineDepthStencilStateCreateInfo depthStencil{};
-    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencil.depthBoundsTestEnable = VK_FALSE;
-    depthStencil.stencilTestEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
     VkPipelineColorBlendAttachmentState colorBlendAttachment{};
     colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -3691,15 +3867,6 @@ void VulkanRenderer::createGraphicsPipeline() {
     dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
     dynamicState.pDynamicStates = dynamicStates.data();
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineInfo.stageCount = 2;
@@ -3709,20 +3876,65 @@ void VulkanRenderer::createGraphicsPipeline() {
     pipelineInfo.pViewportState = &viewportState;
     pipelineInfo.pRasterizationState = &rasterizer;
     pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pDepthStencilState = nullptr; // Nothing to depth test, the quad covers the screen
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = &dynamicState;
     pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.renderPass = targetRenderPass;
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
     vkDestroyShaderModule(device, fragShaderModule, nullptr);
     vkDestroyShaderModule(device, vertShaderModule, nullptr);
+
+    return pipeline;
+}
+
+// Same as createRaymarchPipeline for the compute backend, shader.frag built as a compute shader
+VkPipeline VulkanRenderer::createRaymarchComputePipeline(const std::vector<char>& computeShaderCode, const RaymarchSpecialization* specialization) {
+    VkShaderModule computeShaderModule = createShaderModule(computeShaderCode);
+
+    std::array<VkSpecializationMapEntry, 3> specializationEntries{};
+    for (uint32_t i = 0; i < specializationEntries.size(); i++) {
+        specializationEntries[i].constantID = i;
+        specializationEntries[i].offset = i * sizeof(glm::int32);
+        specializationEntries[i].size = sizeof(glm::int32);
+    }
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(RaymarchSpecialization);
+    specializationInfo.pData = specialization;
+
+    VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
+    computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    computeShaderStageInfo.module = computeShaderModule;
+    computeShaderStageInfo.pName = "main";
+    if (specialization != nullptr) {
+        computeShaderStageInfo.pSpecializationInfo = &specializationInfo;
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = computeShaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(device, computeShaderModule, nullptr);
+
+    return pipeline;
 }
 
 VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code) {
@@ -3740,66 +3952,367 @@ VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code)
 }
 
 
+// Scene Specialized Shader
+// frag.spv interprets the world tree at run time. Whenever the structure of the tree changes it is turned into
+// straight-line GLSL (scene.glsl, included by shader.frag when SCENE_SPECIALIZED is defined), compiled by glslc and
+// built into a pipeline on a worker thread, the generic pipeline keeps rendering until the specialized one is ready.
+// Only the types and links of the tree are baked in, every parameter is still read from the uniform buffer so editing
+// values reuses it. The generated files go to the temp directory rather than next to the sources.
+static const std::string sceneShaderGlslFile = "scene.glsl";
+static const std::string sceneShaderSpvFile = "scene_frag.spv";
+static const std::string sceneComputeShaderSpvFile = "scene_comp.spv";
+
+static std::string glslcPath() {
+    const char* sdk = std::getenv("VULKAN_SDK");
+    if (sdk != nullptr) {
+        return std::string(sdk) + "\\Bin\\glslc.exe";
+    }
+    return "C:\\VulkanSDK\\1.3.290.0\\Bin\\glslc.exe";
+}
+
+static std::filesystem::path sceneShaderDirectory() {
+    return std::filesystem::temp_directory_path() / "Liminools";
+}
+
+static std::string quotePath(const std::filesystem::path& path) {
+    return "\"" + path.string() + "\"";
+}
+
+// The SDK lives under Program Files, so every path is quoted. cmd.exe drops the first and the last quote of a line
+// that starts with one, which is why the whole command gets one more pair.
+static bool runGlslc(const std::string& arguments) {
+    std::string command = "\"" + quotePath(glslcPath()) + " " + arguments + "\"";
+    return std::system(command.c_str()) == 0;
+}
+
+// Folds the buffered combine modifiers the same way map_the_index_dist does and returns
+static std::string sceneShaderFold(const WorldObjectsData& worldData, const std::vector<std::pair<int, std::string>>& buffered, const std::string& indent) {
+    std::string code;
+    for (size_t k = buffered.size(); k > 0; k--) {
+        int modifier = buffered[k - 1].first;
+        std::string index = std::to_string(modifier);
+        code += indent + "{\n";
+        code += indent + "\tPixelInfo temp = map_the_combine_modifier(" + std::to_string(worldData.combineModifiers[modifier].type) + ", cur_dist, " + buffered[k - 1].second + ", cur_object, " + std::to_string(worldData.combineModifiers[modifier].index2) + ", vec3(0.0), vec3(0.0), worldObjectsData.combineModifiers[" + index + "].data1);\n";
+        code += indent + "\tcur_dist = temp.dist;\n";
+        code += indent + "\tcur_object = temp.object;\n";
+        code += indent + "}\n";
+    }
+    code += indent + "result.dist = cur_dist;\n";
+    code += indent + "result.object = cur_object;\n";
+    code += indent + "result.hitPos = p;\n";
+    code += indent + "return result;\n";
+    return code;
+}
+
+static std::string sceneShaderObject(const WorldObjectsData& worldData, int objectIndex) {
+    if (objectIndex < 0 || objectIndex >= MAX_OBJECTS) {
+        return "camData.max_dist";
+    }
+    return "map_the_object_displaced_type(p, worldPos, " + std::to_string(objectIndex) + ", " + std::to_string(worldData.objects[objectIndex].type) + ")";
+}
+
+// One function per world index, walking the chain exactly like map_the_index_dist but unrolled
+std::string VulkanRenderer::generateSceneShader() {
+    const WorldObjectsData& worldData = saveData->worldData;
+    int numIndices = std::min(std::max(worldData.num_indices, 0), MAX_OBJECTS);
+
+    std::string code = "// Generated by VulkanRenderer::generateSceneShader, do not edit\n\n";
+
+    for (int i = 0; i < numIndices; i++) {
+        code += "PixelInfo scene_index_dist_" + std::to_string(i) + "(vec3 p){\n";
+        code += "\tPixelInfo result;\n";
+        code += "\tresult.index = " + std::to_string(i) + ";\n";
+        code += "\tresult.normal = vec3(0.0);\n";
+        code += "\tvec3 worldPos = p;\n";
+        code += "\tfloat cur_dist = 0.0;\n";
+        code += "\tint cur_object = -1;\n";
+
+        std::vector<std::pair<int, std::string>> buffered;
+        int distCount = 0;
+        int type = worldData.indices[i].type;
+        int index = worldData.indices[i].index;
+        int stopCrash = 0;
+
+        while (stopCrash < MAX_OBJECTS) {
+            if (index < 0 || index >= MAX_OBJECTS) {
+                type = 0;
+            }
+
+            if (type == 1) {
+                stopCrash = MAX_OBJECTS;
+                code += "\tcur_dist = " + sceneShaderObject(worldData, index) + ";\n";
+                code += "\tcur_object = " + std::to_string(index) + ";\n";
+                code += "\tp -= worldObjectsData.objects[" + std::to_string(index) + "].center;\n";
+            }
+            else if (type == 2) {
+                stopCrash++;
+                const WorldObjectCombineModifier& modifier = worldData.combineModifiers[index];
+                std::string dist = "d" + std::to_string(distCount++);
+                code += "\tfloat " + dist + " = " + sceneShaderObject(worldData, modifier.index2) + ";\n";
+
+                if (modifier.type == 21) {
+                    code += "\tif(" + dist + " > worldObjectsData.combineModifiers[" + std::to_string(index) + "].data1.x){\n";
+                    code += "\t\tcur_dist = " + dist + ";\n";
+                    code += "\t\tcur_object = " + std::to_string(modifier.index1) + ";\n";
+                    code += sceneShaderFold(worldData, buffered, "\t\t");
+                    code += "\t}\n";
+                    stopCrash++;
+                }
+                else {
+                    buffered.push_back({ index, dist });
+                }
+                type = modifier.index1Type;
+                index = modifier.index1;
+            }
+            else if (type == 3) {
+                stopCrash++;
+                code += "\tmap_the_domain_modifier_type(p, " + std::to_string(index) + ", " + std::to_string(worldData.domainModifiers[index].type) + ");\n";
+                code += "\tcur_dist = 1.0;\n";
+                type = worldData.domainModifiers[index].index1Type;
+                index = worldData.domainModifiers[index].index1;
+            }
+            else {
+                code += "\tcur_dist = camData.max_dist;\n";
+                stopCrash = MAX_OBJECTS;
+            }
+        }
+
+        code += sceneShaderFold(worldData, buffered, "\t");
+        code += "}\n\n";
+    }
+
+    code += "PixelInfo scene_index_dist(vec3 p, int i){\n";
+    code += "\tswitch(i){\n";
+    for (int i = 0; i < numIndices; i++) {
+        code += "\tcase " + std::to_string(i) + ": return scene_index_dist_" + std::to_string(i) + "(p);\n";
+    }
+    code += "\t}\n";
+    code += "\tPixelInfo result;\n";
+    code += "\tresult.dist = camData.max_dist;\n";
+    code += "\tresult.index = i;\n";
+    code += "\tresult.object = -1;\n";
+    code += "\tresult.hitPos = p;\n";
+    code += "\tresult.normal = vec3(0.0);\n";
+    code += "\treturn result;\n";
+    code += "}\n";
+
+    return code;
+}
+
+void VulkanRenderer::updateSceneShader() {
+    SceneShaderState state = sceneShaderState.load();
+    if (state == SceneShaderState::Ready || state == SceneShaderState::Failed) {
+        sceneShaderThread.join();
+        sceneShaderState = SceneShaderState::Idle;
+
+        if (state == SceneShaderState::Failed) {
+            std::cerr << "scene shader compilation failed, staying on the generic shader" << std::endl;
+            sceneShaderFailedSource = sceneShaderCompilingSource;
+        }
+        else {
+            destroyRaymarchPipelineVariants(true);
+            sceneFragShaderCode = std::move(sceneShaderCompiledCode);
+            sceneComputeShaderCode = std::move(sceneComputeShaderCompiledCode);
+            scenePipelineSource = sceneShaderCompilingSource;
+            raymarchPipelineVariants.push_back({ sceneShaderCompiledSpecialization, true, false, sceneShaderCompiledPipeline });
+            raymarchPipelineVariants.push_back({ sceneShaderCompiledSpecialization, true, true, sceneComputeShaderCompiledPipeline });
+            sceneShaderCompiledPipeline = VK_NULL_HANDLE;
+            sceneComputeShaderCompiledPipeline = VK_NULL_HANDLE;
+        }
+    }
+
+    if (sceneShaderState == SceneShaderState::Idle && !sceneShaderSource.empty() && sceneShaderSource != scenePipelineSource && sceneShaderSource != sceneShaderFailedSource) {
+        sceneShaderCompilingSource = sceneShaderSource;
+        sceneShaderState = SceneShaderState::Compiling;
+        sceneShaderThread = std::thread([this, source = sceneShaderSource, specialization = currentRaymarchSpecialization()]() {
+            std::filesystem::path directory = sceneShaderDirectory();
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+            std::ofstream file(directory / sceneShaderGlslFile, std::ios::trunc);
+            file << source;
+            file.close();
+
+            // Both stages are built here and only handed over together once the driver accepted them, so the frame loop
+            // never sees a broken shader or one backend ahead of the other
+            std::filesystem::path spvFile = directory / sceneShaderSpvFile;
+            std::filesystem::path computeSpvFile = directory / sceneComputeShaderSpvFile;
+            std::string arguments = "-DSCENE_SPECIALIZED -O -I " + quotePath(directory) + " " + quotePath("shader.frag");
+            if (runGlslc(arguments + " -o " + quotePath(spvFile)) && runGlslc("-fshader-stage=comp -DCOMPUTE_BACKEND " + arguments + " -o " + quotePath(computeSpvFile))) {
+                try {
+                    sceneShaderCompiledCode = readFile(spvFile.string());
+                    sceneComputeShaderCompiledCode = readFile(computeSpvFile.string());
+                    sceneShaderCompiledSpecialization = specialization;
+                    sceneShaderCompiledPipeline = createRaymarchPipeline(sceneShaderCompiledCode, &specialization, renderPass);
+                    sceneComputeShaderCompiledPipeline = createRaymarchComputePipeline(sceneComputeShaderCompiledCode, &specialization);
+                }
+                catch (const std::runtime_error& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+            }
+            bool built = sceneShaderCompiledPipeline != VK_NULL_HANDLE && sceneComputeShaderCompiledPipeline != VK_NULL_HANDLE;
+            if (!built && sceneShaderCompiledPipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, sceneShaderCompiledPipeline, nullptr);
+                sceneShaderCompiledPipeline = VK_NULL_HANDLE;
+            }
+            sceneShaderState = built ? SceneShaderState::Ready : SceneShaderState::Failed;
+        });
+    }
+}
+
+VkPipeline VulkanRenderer::currentRaymarchPipeline(bool compute) {
+    // The scene shader is only valid for the tree it was generated from
+    bool scene = !sceneFragShaderCode.empty() && scenePipelineSource == sceneShaderSource;
+    try {
+        return getRaymarchPipeline(scene, compute, currentRaymarchSpecialization());
+    }
+    catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return compute ? computePipeline : graphicsPipeline;
+    }
+}
+
+
+// Pipeline Variants
+// The stacks, the texture array and the march loops in shader.frag are sized with specialization constants.
+// Each world gets the smallest variant that fits it, a handful of them are kept so switching back is free.
+#define RAYMARCH_PIPELINE_CACHE_SIZE 8
+
+// Sizes that only depend on the world, updated when it changes
+void VulkanRenderer::updateWorldSpecialization() {
+    const WorldObjectsData& worldData = saveData->worldData;
+    int numIndices = std::min(std::max(worldData.num_indices, 0), MAX_OBJECTS);
+
+    // Same walk as map_the_index_dist, the distance of every combine modifier is written one past the buffered ones
+    int chainStackSize = 1;
+    for (int i = 0; i < numIndices; i++) {
+        int type = worldData.indices[i].type;
+        int index = worldData.indices[i].index;
+        int buffered = 0;
+        int stopCrash = 0;
+        while (stopCrash < MAX_OBJECTS && index >= 0 && index < MAX_OBJECTS) {
+            if (type == 2) {
+                stopCrash++;
+                chainStackSize = std::max(chainStackSize, buffered + 1);
+                if (worldData.combineModifiers[index].type == 21) {
+                    stopCrash++;
+                }
+                else {
+                    buffered++;
+                }
+                type = worldData.combineModifiers[index].index1Type;
+                index = worldData.combineModifiers[index].index1;
+            }
+            else if (type == 3) {
+                stopCrash++;
+                type = worldData.domainModifiers[index].index1Type;
+                index = worldData.domainModifiers[index].index1;
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    // Round up so small edits don't keep creating variants
+    worldChainStackSize = 1;
+    while (worldChainStackSize < chainStackSize) {
+        worldChainStackSize *= 2;
+    }
+    worldChainStackSize = std::min(worldChainStackSize, MAX_OBJECTS);
+
+    // Slot 0 is the skybox
+    int imageCount = 1;
+    int numObjects = std::min(std::max(worldData.num_objects, 0), MAX_OBJECTS);
+    for (int i = 0; i < numObjects; i++) {
+        imageCount = std::max(imageCount, worldData.objects[i].textureIndex + 1);
+        imageCount = std::max(imageCount, worldData.objects[i].int3 + 1);
+    }
+    worldImageCount = std::min(imageCount, MAX_IMAGES);
+}
+
+RaymarchSpecialization VulkanRenderer::currentRaymarchSpecialization() {
+    RaymarchSpecialization specialization{};
+    specialization.chainStackSize = worldChainStackSize;
+    specialization.imageCount = worldImageCount;
+    specialization.maxIterCount = std::min(std::max(saveData->camData.ray_depth, 1), 5);
+    return specialization;
+}
+
+VkPipeline VulkanRenderer::getRaymarchPipeline(bool scene, bool compute, const RaymarchSpecialization& specialization) {
+    for (const RaymarchPipelineVariant& variant : raymarchPipelineVariants) {
+        if (variant.scene == scene && variant.compute == compute && variant.specialization == specialization) {
+            return variant.pipeline;
+        }
+    }
+
+    if (raymarchPipelineVariants.size() >= RAYMARCH_PIPELINE_CACHE_SIZE) {
+        // The oldest variant can still be in use by a frame in flight
+        vkDeviceWaitIdle(device);
+        vkDestroyPipeline(device, raymarchPipelineVariants.front().pipeline, nullptr);
+        raymarchPipelineVariants.erase(raymarchPipelineVariants.begin());
+    }
+
+    VkPipeline pipeline;
+    if (compute) {
+        pipeline = createRaymarchComputePipeline(scene ? sceneComputeShaderCode : genericComputeShaderCode, &specialization);
+    }
+    else {
+        pipeline = createRaymarchPipeline(scene ? sceneFragShaderCode : genericFragShaderCode, &specialization, renderPass);
+    }
+    raymarchPipelineVariants.push_back({ specialization, scene, compute, pipeline });
+    return pipeline;
+}
+
+void VulkanRenderer::destroyRaymarchPipelineVariants(bool scene) {
+    bool waited = false;
+    for (auto it = raymarchPipelineVariants.begin(); it != raymarchPipelineVariants.end(); ) {
+        if (it->scene == scene) {
+            if (!waited) {
+                vkDeviceWaitIdle(device);
+                waited = true;
+            }
+            vkDestroyPipeline(device, it->pipeline, nullptr);
+            it = raymarchPipelineVariants.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+
 // Create Render Pass
+// Just the swap chain image, the raymarch is one full screen quad and ImGui is drawn over it so there is nothing to
+// multisample or depth test. Anti-aliasing is done by the compute backend's edge supersampling instead.
 void VulkanRenderer::createRenderPass() {
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = swapChainImageFormat;
-    colorAttachment.samples = msaaSamples;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentDescription depthAttachment{};
-    depthAttachment.format = findDepthFormat();
-    depthAttachment.samples = msaaSamples;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentDescription colorAttachmentResolve{};
-    colorAttachmentResolve.format = swapChainImageFormat;
-    colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    VkAttachmentReference depthAttachmentRef{};
-    depthAttachmentRef.attachment = 1;
-    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference colorAttachmentResolveRef{};
-    colorAttachmentResolveRef.attachment = 2;
-    colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
-    subpass.pResolveAttachments = &colorAttachmentResolveRef;
 
     VkSubpassDependency dependency{};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
-    std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
+    std::array<VkAttachmentDescription, 1> attachments = { colorAttachment };
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
@@ -3815,152 +4328,1049 @@ void VulkanRenderer::createRenderPass() {
 }
 
 
-// Create Frame Buffers
-void VulkanRenderer::createFramebuffers() {
-    swapChainFramebuffers.resize(swapChainImageViews.size());
+// Cone Prepass
+// Before the raymarch pass, one fragment per CONE_PREPASS_TILE_SIZE^2 tile marches a cone covering the whole tile and
+// writes how far it got (R32 float). The raymarch pass starts its primary rays there, which skips the long empty
+// stretches of sky and floor rays. When it's turned off the image is only cleared, every ray then starts at 0.
+void VulkanRenderer::createConePrepassRenderPass() {
+    VkAttachmentDescription distAttachment{};
+    distAttachment.format = VK_FORMAT_R32_SFLOAT;
+    distAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    distAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    distAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    distAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    distAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    distAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    distAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        std::array<VkImageView, 3> attachments = {
-            colorImageView,
-            depthImageView,
-            swapChainImageViews[i]
-        };
+    VkAttachmentReference distAttachmentRef{};
+    distAttachmentRef.attachment = 0;
+    distAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        framebufferInfo.pAttachments = attachments.data();
-        framebufferInfo.width = swapChainExtent.width;
-        framebufferInfo.height = swapChainExtent.height;
-        framebufferInfo.layers = 1;
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &distAttachmentRef;
+
+    // The previous frame's raymarch pass or dispatch has to be done reading before it's overwritten, and this frame's has to wait for it
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create framebuffer!");
-        }
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &distAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &conePrepassRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cone prepass render pass!");
     }
 }
 
+void VulkanRenderer::createConePrepassResources() {
+    conePrepassExtent.width = (swapChainExtent.width + CONE_PREPASS_TILE_SIZE - 1) / CONE_PREPASS_TILE_SIZE;
+    conePrepassExtent.height = (swapChainExtent.height + CONE_PREPASS_TILE_SIZE - 1) / CONE_PREPASS_TILE_SIZE;
 
-// Create Command Buffers
-void VulkanRenderer::createCommandPool() {
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    createImage(conePrepassExtent.width, conePrepassExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, conePrepassImage, conePrepassImageMemory);
+    conePrepassImageView = createImageView(conePrepassImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
-    VkCommandPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = conePrepassRenderPass;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = &conePrepassImageView;
+    framebufferInfo.width = conePrepassExtent.width;
+    framebufferInfo.height = conePrepassExtent.height;
+    framebufferInfo.layers = 1;
 
-    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create graphics command pool!");
+    if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &conePrepassFramebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cone prepass framebuffer!");
     }
 }
 
-void VulkanRenderer::createCommandBuffers() {
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
-
-    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate command buffers!");
-    }
+void VulkanRenderer::cleanupConePrepassResources() {
+    vkDestroyFramebuffer(device, conePrepassFramebuffer, nullptr);
+    vkDestroyImageView(device, conePrepassImageView, nullptr);
+    vkDestroyImage(device, conePrepassImage, nullptr);
+    vkFreeMemory(device, conePrepassImageMemory, nullptr);
 }
 
-// This is the main command list for each draw call, this is probably what will be updated to add new uniforms and stuff
-void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-        throw std::runtime_error("failed to begin recording command buffer!");
-    }
-
+void VulkanRenderer::recordConePrepass(VkCommandBuffer commandBuffer) {
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = { 0, 0 };
-    renderPassInfo.renderArea.extent = swapChainExtent;
+    // Only the tiles of the part that gets raymarched
+    VkExtent2D tileExtent{};
+    tileExtent.width = (renderExtent.width + CONE_PREPASS_TILE_SIZE - 1) / CONE_PREPASS_TILE_SIZE;
+    tileExtent.height = (renderExtent.height + CONE_PREPASS_TILE_SIZE - 1) / CONE_PREPASS_TILE_SIZE;
 
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
-    clearValues[1].depthStencil = { 1.0f, 0 };
+    renderPassInfo.renderPass = conePrepassRenderPass;
+    renderPassInfo.framebuffer = conePrepassFramebuffer;
+    renderPassInfo.renderArea.offset = { 0, 0 };
+    renderPassInfo.renderArea.extent = tileExtent;
 
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
+    VkClearValue clearValue{};
+    clearValue.color = { {0.0f, 0.0f, 0.0f, 0.0f} };
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearValue;
 
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    if (settings.conePrepass) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, conePrepassPipeline);
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swapChainExtent.width;
-    viewport.height = (float)swapChainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)tileExtent.width;
+        viewport.height = (float)tileExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-    VkRect2D scissor{};
-    scissor.offset = { 0, 0 };
-    scissor.extent = swapChainExtent;
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        // The tiles the raymarch will read, the rest stay cleared
+        VkRect2D scissor{};
+        scissor.offset.x = raymarchRect.offset.x / CONE_PREPASS_TILE_SIZE;
+        scissor.offset.y = raymarchRect.offset.y / CONE_PREPASS_TILE_SIZE;
+        scissor.extent.width = std::min(tileExtent.width, (raymarchRect.offset.x + raymarchRect.extent.width + CONE_PREPASS_TILE_SIZE - 1) / CONE_PREPASS_TILE_SIZE) - scissor.offset.x;
+        scissor.extent.height = std::min(tileExtent.height, (raymarchRect.offset.y + raymarchRect.extent.height + CONE_PREPASS_TILE_SIZE - 1) / CONE_PREPASS_TILE_SIZE) - scissor.offset.y;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    VkBuffer vertexBuffers[] = { vertexBuffer };
-    VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        VkBuffer vertexBuffers[] = { vertexBuffer };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
 
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
 
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    }
 
-    ImGui_ImplVulkan_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
+    vkCmdEndRenderPass(commandBuffer);
+}
 
-    //ImGui::ShowDemoWindow();
 
-    imgui.drawWindow();
+// Compute Backend
+// The raymarch runs as a compute shader over 8x8 tiles (the same tiles as the cone prepass) into raymarchImage, the
+// swap chain pass then only copies it with compositePipeline before ImGui is drawn. The fragment backend is kept as a
+// fallback and draws straight into the swap chain pass like before.
 
-    ImGui::Render();
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer, 0, NULL);
+// Deferred shading (settings.deferredShading) splits pass 0 into the G-buffer, lighting, shadow and bounce passes, in
+// this order with a barrier between each. The checkerboard's first pass stays the single pass.
+static const std::array<int, 4> DEFERRED_PASSES = { 5, 6, 7, 8 };
 
-    vkCmdEndRenderPass(commandBuffer);
+void VulkanRenderer::createRaymarchImage() {
+    createImage(swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, raymarchImage, raymarchImageMemory);
+    raymarchImageView = createImageView(raymarchImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    transitionImageLayout(raymarchImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1);
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
+    // 32 bit so hundreds of samples can be averaged without banding
+    createImage(swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, historyImage, historyImageMemory);
+    historyImageView = createImageView(historyImage, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    transitionImageLayout(historyImage, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1);
+
+    for (size_t i = 0; i < reprojectionImages.size(); i++) {
+        createImage(swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, reprojectionImages[i], reprojectionImagesMemory[i]);
+        reprojectionImageViews[i] = createImageView(reprojectionImages[i], VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        transitionImageLayout(reprojectionImages[i], VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1);
     }
-}
 
+    createImage(swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, objectIdImage, objectIdImageMemory);
+    objectIdImageView = createImageView(objectIdImage, VK_FORMAT_R32_SINT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    transitionImageLayout(objectIdImage, VK_FORMAT_R32_SINT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1);
 
-// Create Synchronization Objects
-void VulkanRenderer::createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    // Unsigned so the splat can atomicMin the distances, cleared every frame it's used
+    createImage(swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthSeedImage, depthSeedImageMemory);
+    depthSeedImageView = createImageView(depthSeedImage, VK_FORMAT_R32_UINT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    transitionImageLayout(depthSeedImage, VK_FORMAT_R32_UINT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1);
+
+    createGBufferImages();
+
+    renderExtent = swapChainExtent;
+    accumulationValid = false;
+    sceneImageValid = false;
+    reprojectionValid = false;
+    progressiveValid = false;
+}
+
+void VulkanRenderer::cleanupRaymarchImage() {
+    vkDestroyImageView(device, raymarchImageView, nullptr);
+    vkDestroyImage(device, raymarchImage, nullptr);
+    vkFreeMemory(device, raymarchImageMemory, nullptr);
+
+    vkDestroyImageView(device, historyImageView, nullptr);
+    vkDestroyImage(device, historyImage, nullptr);
+    vkFreeMemory(device, historyImageMemory, nullptr);
+
+    for (size_t i = 0; i < reprojectionImages.size(); i++) {
+        vkDestroyImageView(device, reprojectionImageViews[i], nullptr);
+        vkDestroyImage(device, reprojectionImages[i], nullptr);
+        vkFreeMemory(device, reprojectionImagesMemory[i], nullptr);
+    }
+
+    vkDestroyImageView(device, objectIdImageView, nullptr);
+    vkDestroyImage(device, objectIdImage, nullptr);
+    vkFreeMemory(device, objectIdImageMemory, nullptr);
+
+    vkDestroyImageView(device, depthSeedImageView, nullptr);
+    vkDestroyImage(device, depthSeedImage, nullptr);
+    vkFreeMemory(device, depthSeedImageMemory, nullptr);
+
+    cleanupGBufferImages();
+}
+
+void VulkanRenderer::recordRaymarchDispatch(VkCommandBuffer commandBuffer) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = raymarchImage;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    // The previous frame's composite has to be done reading it
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // And the previous frame's dispatch has to be done with the history and the reprojection images, the second
+    // checkerboard pass reads what the first wrote
+    VkMemoryBarrier storageBarrier{};
+    storageBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    storageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    storageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &storageBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, currentRaymarchPipeline(true));
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+
+    // The last frame has to be there at the same size, and an accumulating frame shades every pixel
+    if (renderExtent.width != reprojectionExtent.width || renderExtent.height != reprojectionExtent.height) {
+        reprojectionValid = false;
+    }
+    bool progressive = settings.progressiveTiles;
+    bool checkerboard = settings.checkerboard && !progressive && reprojectionValid && raymarchConstants.sampleIndex == 0;
+
+    raymarchConstants.prevCameraPos = glm::vec4(reprojectionSource.camData.camera_pos, reprojectionSource.camData.data4.x);
+    raymarchConstants.prevCameraRot = glm::vec4(reprojectionSource.camData.camera_rot, 0.0f);
+    raymarchConstants.frameParity = reprojectionParity;
+    raymarchConstants.tileOffset = glm::ivec2(raymarchRect.offset.x, raymarchRect.offset.y);
+    raymarchConstants.shadowsOff = previewActive ? 1 : 0;
+    uint32_t groupsX = (raymarchRect.extent.width + 7) / 8;
+    uint32_t groupsY = (raymarchRect.extent.height + 7) / 8;
+
+    // A progressive round never has a whole last frame to splat
+    raymarchConstants.seedDepth = settings.reprojectDepth && !progressive && reprojectionValid && reprojectionGeometryCurrent() ? 1 : 0;
+    if (raymarchConstants.seedDepth != 0) {
+        recordDepthSeed(commandBuffer, storageBarrier);
+    }
+
+    if (progressive) {
+        recordProgressiveTiles(commandBuffer, storageBarrier);
+    }
+    else if (checkerboard) {
+        uint32_t checkerboardGroupsX = ((raymarchRect.extent.width + 1) / 2 + 7) / 8;
+
+        raymarchConstants.pass = 1;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RaymarchConstants), &raymarchConstants);
+        vkCmdDispatch(commandBuffer, checkerboardGroupsX, groupsY, 1);
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &storageBarrier, 0, nullptr, 0, nullptr);
+
+        raymarchConstants.pass = 2;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RaymarchConstants), &raymarchConstants);
+        vkCmdDispatch(commandBuffer, checkerboardGroupsX, groupsY, 1);
+    }
+    else if (settings.deferredShading) {
+        for (size_t i = 0; i < DEFERRED_PASSES.size(); i++) {
+            if (i > 0) {
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &storageBarrier, 0, nullptr, 0, nullptr);
+            }
+            raymarchConstants.pass = DEFERRED_PASSES[i];
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RaymarchConstants), &raymarchConstants);
+            vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+        }
+    }
+    else {
+        raymarchConstants.pass = 0;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RaymarchConstants), &raymarchConstants);
+        vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+    }
+
+    // Extra rays only where the finished primary pass has an edge, accumulating frames are anti-aliased by their jitter
+    if (!progressive && settings.edgeSupersampling && raymarchConstants.sampleIndex == 0) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &storageBarrier, 0, nullptr, 0, nullptr);
+
+        raymarchConstants.pass = 3;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RaymarchConstants), &raymarchConstants);
+        vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+    }
+
+    // A progressive round does this once its last tile is in
+    if (!progressive) {
+        memcpy(&sceneImageSource, saveData, sizeof(SaveData));
+        sceneImageExtent = renderExtent;
+        sceneImageValid = true;
+
+        // This frame is the next one's last frame
+        memcpy(&reprojectionSource, saveData, sizeof(SaveData));
+        reprojectionExtent = renderExtent;
+        reprojectionValid = true;
+        reprojectionParity ^= 1;
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+
+// Progressive Tiles
+// On a heavy world one raymarch can take hundreds of milliseconds and ImGui freezes along with it. With
+// settings.progressiveTiles the compute backend marches PROGRESSIVE_TILE_SIZE tiles in rows from the top, only as many
+// per frame as fit settings.tileBudget going by the GPU time of the last frames, and the composite shows raymarchImage
+// with whatever is done so far. A round is one sample over every tile, so with temporal accumulation the next sample
+// only starts once the round is done. Anything changing starts the round over.
+void VulkanRenderer::recordProgressiveTiles(VkCommandBuffer commandBuffer, const VkMemoryBarrier& storageBarrier) {
+    // Only the tiles of raymarchRect, it changing throws the round away like a new extent
+    uint32_t tilesX = (raymarchRect.extent.width + PROGRESSIVE_TILE_SIZE - 1) / PROGRESSIVE_TILE_SIZE;
+    uint32_t tilesY = (raymarchRect.extent.height + PROGRESSIVE_TILE_SIZE - 1) / PROGRESSIVE_TILE_SIZE;
+
+    if (!progressiveValid || renderExtent.width != progressiveExtent.width || renderExtent.height != progressiveExtent.height
+        || raymarchConstants.sampleIndex != progressiveSampleIndex || saveDataChanged(progressiveSource)) {
+        memcpy(&progressiveSource, saveData, sizeof(SaveData));
+        progressiveExtent = renderExtent;
+        progressiveSampleIndex = raymarchConstants.sampleIndex;
+        progressiveTileCount = tilesX * tilesY;
+        progressiveCursor = 0;
+        progressiveValid = true;
+        // Until the round is done the images are part this round and part the last one
+        sceneImageValid = false;
+        reprojectionValid = false;
+    }
+    progressiveFrameFirstTile = progressiveCursor;
+
+    uint32_t tileEnd = std::min(progressiveTileCount, progressiveCursor + static_cast<uint32_t>(std::max(progressiveTileRate, 1.0f)));
+    frameTiles[currentFrame] = tileEnd - progressiveCursor;
+
+    // The tiles of a row next to each other go in one dispatch
+    auto dispatchTiles = [&](int pass) {
+        raymarchConstants.pass = pass;
+        for (uint32_t tile = progressiveCursor; tile < tileEnd; ) {
+            uint32_t rowEnd = std::min(tileEnd, (tile / tilesX + 1) * tilesX);
+            raymarchConstants.tileOffset = glm::ivec2(raymarchRect.offset.x + (tile % tilesX) * PROGRESSIVE_TILE_SIZE, raymarchRect.offset.y + (tile / tilesX) * PROGRESSIVE_TILE_SIZE);
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RaymarchConstants), &raymarchConstants);
+            vkCmdDispatch(commandBuffer, (rowEnd - tile) * PROGRESSIVE_TILE_SIZE / 8, PROGRESSIVE_TILE_SIZE / 8, 1);
+            tile = rowEnd;
+        }
+    };
+
+    if (settings.deferredShading) {
+        for (size_t i = 0; i < DEFERRED_PASSES.size(); i++) {
+            if (i > 0) {
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &storageBarrier, 0, nullptr, 0, nullptr);
+            }
+            dispatchTiles(DEFERRED_PASSES[i]);
+        }
+    }
+    else {
+        dispatchTiles(0);
+    }
+    // The tiles' edges look at the neighbors of the last round that haven't been marched yet, at worst a pixel gets
+    // supersampled that didn't need it
+    if (settings.edgeSupersampling && raymarchConstants.sampleIndex == 0) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &storageBarrier, 0, nullptr, 0, nullptr);
+        dispatchTiles(3);
+    }
+
+    progressiveCursor = tileEnd;
+    stats.progressiveTilesDone = static_cast<int>(progressiveCursor);
+    stats.progressiveTileCount = static_cast<int>(progressiveTileCount);
+
+    if (progressiveCursor == progressiveTileCount) {
+        memcpy(&sceneImageSource, &progressiveSource, sizeof(SaveData));
+        sceneImageExtent = renderExtent;
+        sceneImageValid = true;
+
+        memcpy(&reprojectionSource, &progressiveSource, sizeof(SaveData));
+        reprojectionExtent = renderExtent;
+        reprojectionValid = true;
+        reprojectionParity ^= 1;
+    }
+}
+
+bool VulkanRenderer::progressiveTilesPending() {
+    return settings.computeBackend && settings.progressiveTiles && progressiveValid && progressiveCursor < progressiveTileCount;
+}
+
+
+// Depth Seeding
+// Primary rays would start at 0 (or the cone prepass depth) every frame even though the camera only moved a little.
+// With settings.reprojectDepth the last frame's primary hit distances (the alpha of the reprojection images) are
+// splatted into this frame's pixels with the two camera poses before the primary pass, the nearest one landing on a
+// pixel wins. The primary pass starts a bit short of the nearest splat around its pixel, checks that point with one
+// distance evaluation and starts at 0 if it's inside something or nothing landed near it (disocclusion).
+void VulkanRenderer::recordDepthSeed(VkCommandBuffer commandBuffer, const VkMemoryBarrier& storageBarrier) {
+    // The last frame's primary pass has to be done reading the old splats before they're cleared
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    // All bits set is above the bits of every distance, so atomicMin replaces it with the first splat
+    VkClearColorValue empty{};
+    empty.uint32[0] = 0xFFFFFFFF;
+    VkImageSubresourceRange range{};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = 0;
+    range.levelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+    vkCmdClearColorImage(commandBuffer, depthSeedImage, VK_IMAGE_LAYOUT_GENERAL, &empty, 1, &range);
+
+    VkMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+    // One invocation per pixel the last frame marched, raymarchRect didn't change or the reprojection would be invalid
+    raymarchConstants.pass = 4;
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RaymarchConstants), &raymarchConstants);
+    vkCmdDispatch(commandBuffer, (raymarchRect.extent.width + 7) / 8, (raymarchRect.extent.height + 7) / 8, 1);
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &storageBarrier, 0, nullptr, 0, nullptr);
+}
+
+// The splatted depth is only a safe start while the geometry is what the last frame marched, only the camera may move
+bool VulkanRenderer::reprojectionGeometryCurrent() {
+    SaveData source;
+    memcpy(&source, &reprojectionSource, sizeof(SaveData));
+    source.camData.camera_pos = saveData->camData.camera_pos;
+    source.camData.camera_rot = saveData->camData.camera_rot;
+    return !saveDataChanged(source);
+}
+
+
+// Deferred Shading
+// The G-buffer images take 40 bytes a pixel, hundreds of MB at 4K, so they're only swap chain sized while
+// settings.deferredShading is on. Otherwise they're 1x1 so the descriptor sets still have something to point to.
+void VulkanRenderer::createGBufferImages() {
+    gBufferImagesFull = settings.deferredShading;
+    uint32_t width = gBufferImagesFull ? swapChainExtent.width : 1;
+    uint32_t height = gBufferImagesFull ? swapChainExtent.height : 1;
+
+    createImage(width, height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gBufferImage, gBufferImageMemory);
+    gBufferImageView = createImageView(gBufferImage, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    transitionImageLayout(gBufferImage, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1);
+
+    createImage(width, height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32G32B32A32_SINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gBufferIdImage, gBufferIdImageMemory);
+    gBufferIdImageView = createImageView(gBufferIdImage, VK_FORMAT_R32G32B32A32_SINT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    transitionImageLayout(gBufferIdImage, VK_FORMAT_R32G32B32A32_SINT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1);
+
+    createImage(width, height, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, lightingImage, lightingImageMemory);
+    lightingImageView = createImageView(lightingImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    transitionImageLayout(lightingImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1);
+}
+
+void VulkanRenderer::cleanupGBufferImages() {
+    vkDestroyImageView(device, gBufferImageView, nullptr);
+    vkDestroyImage(device, gBufferImage, nullptr);
+    vkFreeMemory(device, gBufferImageMemory, nullptr);
+
+    vkDestroyImageView(device, gBufferIdImageView, nullptr);
+    vkDestroyImage(device, gBufferIdImage, nullptr);
+    vkFreeMemory(device, gBufferIdImageMemory, nullptr);
+
+    vkDestroyImageView(device, lightingImageView, nullptr);
+    vkDestroyImage(device, lightingImage, nullptr);
+    vkFreeMemory(device, lightingImageMemory, nullptr);
+}
+
+// Deferred shading was turned on or off in the Renderer panel
+void VulkanRenderer::updateGBufferImages() {
+    if (settings.deferredShading == gBufferImagesFull) return;
+
+    vkDeviceWaitIdle(device);
+    cleanupGBufferImages();
+    createGBufferImages();
+    updateDescriptorSets();
+}
+
+// Interaction Preview
+// While the camera moves (main.cpp calls noteInteraction from the movement keys and mouse look) or a UI item is being
+// dragged, the frames are drawn at the preview tier: settings.previewRenderScale of the resolution, num_steps capped to
+// settings.previewSteps, one ray bounce and no shadows. Only the uploaded camera data and the push constants change,
+// not the SaveData, so the images remembered at the other tier are thrown away whenever it switches. PREVIEW_HOLD after
+// the last interaction it switches back and the full quality frame refines like any other.
+void VulkanRenderer::noteInteraction() {
+    lastInteraction = std::chrono::steady_clock::now();
+    interactionNoted = true;
+}
+
+void VulkanRenderer::updateInteractionPreview() {
+    if (interactionNoted && std::chrono::duration<float>(std::chrono::steady_clock::now() - lastInteraction).count() >= PREVIEW_HOLD) {
+        interactionNoted = false;
+    }
+
+    bool preview = settings.interactionPreview && interactionNoted;
+    if (preview != previewActive) {
+        accumulationValid = false;
+        sceneImageValid = false;
+        progressiveValid = false;
+        previewActive = preview;
+    }
+}
+
+
+// Covered Pixels
+// The World Builder panel is opaque and pinned to the left edge, nothing raymarched under it is ever seen. Windows that
+// call markOpaqueWindow() while the UI is built leave their rectangle, and the ones that span the whole height or width
+// from an edge of what's left cut it down. The fragment backend and the composite are scissored to uiVisibleRect and
+// the compute backend only dispatches raymarchRect, which keeps a group of covered pixels around the visible part so
+// the edge, checkerboard and upscale neighbors are still fresh. Anything that remembers the image starts over when the
+// rect changes, the pixels that were covered are stale.
+void VulkanRenderer::markOpaqueWindow() {
+    if (ImGui::IsWindowCollapsed()) return;
+
+    ImVec2 scale = ImGui::GetIO().DisplayFramebufferScale;
+    ImVec2 pos = ImGui::GetWindowPos();
+    ImVec2 size = ImGui::GetWindowSize();
+    uiOpaqueRects.push_back(glm::vec4(pos.x * scale.x, pos.y * scale.y, (pos.x + size.x) * scale.x, (pos.y + size.y) * scale.y));
+}
+
+void VulkanRenderer::updateRaymarchRect() {
+    glm::vec2 visibleMin(0.0f);
+    glm::vec2 visibleMax(swapChainExtent.width, swapChainExtent.height);
+    if (settings.skipCoveredPixels) {
+        for (const glm::vec4& rect : uiOpaqueRects) {
+            bool fullHeight = rect.y <= visibleMin.y && rect.w >= visibleMax.y;
+            bool fullWidth = rect.x <= visibleMin.x && rect.z >= visibleMax.x;
+            if (fullHeight && rect.x <= visibleMin.x) visibleMin.x = std::max(visibleMin.x, rect.z);
+            else if (fullHeight && rect.z >= visibleMax.x) visibleMax.x = std::min(visibleMax.x, rect.x);
+            else if (fullWidth && rect.y <= visibleMin.y) visibleMin.y = std::max(visibleMin.y, rect.w);
+            else if (fullWidth && rect.w >= visibleMax.y) visibleMax.y = std::min(visibleMax.y, rect.y);
+        }
+    }
+    visibleMax = glm::max(visibleMin, visibleMax);
+
+    uiVisibleRect.offset = { static_cast<int32_t>(std::floor(visibleMin.x)), static_cast<int32_t>(std::floor(visibleMin.y)) };
+    uiVisibleRect.extent.width = static_cast<uint32_t>(std::ceil(visibleMax.x)) - uiVisibleRect.offset.x;
+    uiVisibleRect.extent.height = static_cast<uint32_t>(std::ceil(visibleMax.y)) - uiVisibleRect.offset.y;
+
+    // Into renderExtent, the start rounded down to whole groups (even for the checkerboard) with one more as the margin
+    glm::vec2 renderScale(renderExtent.width / (float)swapChainExtent.width, renderExtent.height / (float)swapChainExtent.height);
+    glm::ivec2 renderMin = glm::ivec2(glm::floor(visibleMin * renderScale));
+    glm::ivec2 renderMax = glm::ivec2(glm::ceil(visibleMax * renderScale));
+    renderMin = glm::max(glm::ivec2(0), renderMin / 8 * 8 - 8);
+    renderMax = glm::min(glm::ivec2(renderExtent.width, renderExtent.height), renderMax + 8);
+    renderMax = glm::max(renderMin, renderMax);
+
+    VkRect2D rect{};
+    rect.offset = { renderMin.x, renderMin.y };
+    rect.extent = { static_cast<uint32_t>(renderMax.x - renderMin.x), static_cast<uint32_t>(renderMax.y - renderMin.y) };
+    if (rect.offset.x != raymarchRect.offset.x || rect.offset.y != raymarchRect.offset.y
+        || rect.extent.width != raymarchRect.extent.width || rect.extent.height != raymarchRect.extent.height) {
+        accumulationValid = false;
+        sceneImageValid = false;
+        reprojectionValid = false;
+        progressiveValid = false;
+    }
+    raymarchRect = rect;
+}
+
+
+// Dynamic Resolution
+// The GPU time of every frame is measured with timestamps at the start and the end of its command buffer. When it's
+// over settings.targetFrameTime the compute backend raymarches a smaller part of raymarchImage and the composite
+// scales it up to the swap chain, when it's under the part grows back towards the full size.
+void VulkanRenderer::createTimestampQueries() {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    frameTimed.assign(MAX_FRAMES_IN_FLIGHT, false);
+    frameRenderScale.assign(MAX_FRAMES_IN_FLIGHT, 1.0f);
+    frameTiles.assign(MAX_FRAMES_IN_FLIGHT, 0);
+
+    if (!properties.limits.timestampComputeAndGraphics) {
+        std::cerr << "GPU timestamps not supported, dynamic resolution is disabled" << std::endl;
+        return;
+    }
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2;
+
+    if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+}
+
+// Called once the current frame's timeline value has been waited on, so its timestamps from the last time around are done
+void VulkanRenderer::updateRenderScale() {
+    if (timestampQueryPool != VK_NULL_HANDLE && frameTimed[currentFrame]) {
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(device, timestampQueryPool, currentFrame * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            stats.gpuFrameTime = static_cast<float>(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0f;
+
+            // Tiles take about the same time each, so the rate scales with how far under or over the budget they were
+            if (frameTiles[currentFrame] > 0 && stats.gpuFrameTime > 0.0f) {
+                float targetRate = frameTiles[currentFrame] * std::max(settings.tileBudget, 0.1f) / stats.gpuFrameTime;
+                progressiveTileRate += (targetRate - progressiveTileRate) * 0.5f;
+                progressiveTileRate = std::clamp(progressiveTileRate, 1.0f, 4096.0f);
+            }
+        }
+    }
+
+    if (!settings.computeBackend || !settings.dynamicResolution || timestampQueryPool == VK_NULL_HANDLE) {
+        stats.renderScale = 1.0f;
+    }
+    else if (sceneImageCurrent()) {
+        // Hold the resolution while the scene is cached or the history is converging, changing it would throw them away
+    }
+    else if (settings.progressiveTiles) {
+        // The tile budget keeps the frame time down instead, a new resolution would start the round over
+    }
+    else if (previewActive) {
+        // Preview frames are cheap on purpose, they'd pull the full quality scale up
+    }
+    else if (stats.gpuFrameTime > 0.0f) {
+        // The time goes with the number of pixels, so the scale of each side goes with its square root. The frame
+        // measured was recorded a few frames ago, so only move part of the way to avoid overshooting.
+        float targetScale = frameRenderScale[currentFrame] * std::sqrt(settings.targetFrameTime / stats.gpuFrameTime);
+        stats.renderScale += (targetScale - stats.renderScale) * 0.2f;
+        stats.renderScale = std::clamp(stats.renderScale, std::clamp(settings.minRenderScale, 0.1f, 1.0f), 1.0f);
+    }
+
+    float scale = stats.renderScale;
+    if (previewActive && settings.computeBackend) {
+        scale *= std::clamp(settings.previewRenderScale, 0.1f, 1.0f);
+    }
+
+    renderExtent.width = std::max(1u, static_cast<uint32_t>(swapChainExtent.width * scale + 0.5f));
+    renderExtent.height = std::max(1u, static_cast<uint32_t>(swapChainExtent.height * scale + 0.5f));
+    renderExtent.width = std::min(renderExtent.width, swapChainExtent.width);
+    renderExtent.height = std::min(renderExtent.height, swapChainExtent.height);
+}
+
+
+// Temporal Accumulation
+// While the camera and the SaveData stay the same (saveDataChanged) every compute backend frame marches one more
+// sample per pixel, jittered inside the pixel, and averages it into historyImage. Anything changing, including the render extent,
+// starts the average over. Once there are settings.maxAccumulatedSamples the raymarch isn't run at all and the
+// composite keeps showing the converged image.
+static float halton(uint32_t index, uint32_t base) {
+    float result = 0.0f;
+    float fraction = 1.0f / base;
+    while (index > 0) {
+        result += fraction * (index % base);
+        index /= base;
+        fraction /= base;
+    }
+    return result;
+}
+
+void VulkanRenderer::updateAccumulation() {
+    bool unchanged = accumulationValid && settings.computeBackend && settings.temporalAccumulation
+        && renderExtent.width == accumulationExtent.width && renderExtent.height == accumulationExtent.height
+        && !saveDataChanged(accumulationSource);
+
+    if (!unchanged) {
+        memcpy(&accumulationSource, saveData, sizeof(SaveData));
+        accumulationExtent = renderExtent;
+        accumulationValid = true;
+        stats.accumulatedSamples = 0;
+    }
+    else if (!accumulationConverged() && !progressiveTilesPending()) {
+        stats.accumulatedSamples++;
+    }
+    if (accumulationConverged()) return;
+
+    // The first sample is the pixel center so a moving camera looks the same as without accumulation
+    raymarchConstants.sampleIndex = stats.accumulatedSamples;
+    if (stats.accumulatedSamples == 0) {
+        raymarchConstants.jitter = glm::vec2(0.0f);
+    }
+    else {
+        raymarchConstants.jitter = glm::vec2(halton(stats.accumulatedSamples, 2), halton(stats.accumulatedSamples, 3)) - 0.5f;
+    }
+}
+
+// Every sample the history is allowed to have has been marched, nothing to dispatch
+bool VulkanRenderer::accumulationConverged() {
+    return settings.computeBackend && settings.temporalAccumulation && stats.accumulatedSamples >= std::max(1, settings.maxAccumulatedSamples);
+}
+
+// Only the wiggle objects and the world and camera move modifiers read camData.time
+bool VulkanRenderer::worldUsesTime() {
+    int numObjects = std::min(std::max(saveData->worldData.num_objects, 0), MAX_OBJECTS);
+    for (int i = 0; i < numObjects; i++) {
+        int type = saveData->worldData.objects[i].type;
+        if (type == 15 || type == 16) return true; // Wiggle Sphere Move, Wiggle Plane Move
+    }
+    int numDomainModifiers = std::min(std::max(saveData->worldData.num_domain_modifiers, 0), MAX_OBJECTS);
+    for (int i = 0; i < numDomainModifiers; i++) {
+        int type = saveData->worldData.domainModifiers[i].type;
+        if (type >= 13 && type <= 16) return true; // Wiggle World/Cam Move 3D, Rotate World/Cam Move 3D
+    }
+    return false;
+}
+
+// Whether the shaders would see anything different from source. camData.time goes up every frame, so it only counts
+// when something uses it, or the accumulation (and everything else that remembers a SaveData) would never hold.
+bool VulkanRenderer::saveDataChanged(const SaveData& source) {
+    if (memcmp(&source.worldData, &saveData->worldData, sizeof(WorldObjectsData)) != 0) return true;
+
+    CameraData camData;
+    memcpy(&camData, &saveData->camData, sizeof(CameraData));
+    if (!worldUsesTime()) {
+        camData.time = source.camData.time;
+    }
+    return memcmp(&source.camData, &camData, sizeof(CameraData)) != 0;
+}
+
+
+// Render On Demand
+// main.cpp asks needsRedraw() before drawing and blocks on events when nothing changed. The SaveData is compared to
+// what the last frame uploaded, input and window events ask for a few frames through requestRedraw(), and a compute
+// backend frame that's still accumulating samples keeps drawing until it converges.
+bool VulkanRenderer::needsRedraw() {
+    if (!settings.renderOnDemand || redrawFrames > 0 || framebufferResized || !drawnSaveDataValid) return true;
+    if (settings.computeBackend && settings.temporalAccumulation && !accumulationConverged()) return true;
+    if (progressiveTilesPending()) return true;
+    // Keeps drawing until the hold is over and the full quality frame is in
+    if (previewActive || interactionNoted) return true;
+    return saveDataChanged(drawnSaveData);
+}
+
+void VulkanRenderer::requestRedraw() {
+    redrawFrames = std::max(redrawFrames, 3);
+}
+
+
+// Scene Cache
+// The compute backend's raymarchImage outlives the frame, so a frame where only ImGui changed (hovering, scrolling,
+// opening a header) composites the last raymarch instead of marching again. The fragment backend marches straight
+// into the swap chain pass and has nothing to reuse.
+bool VulkanRenderer::sceneImageCurrent() {
+    return settings.computeBackend && sceneImageValid
+        && renderExtent.width == sceneImageExtent.width && renderExtent.height == sceneImageExtent.height
+        && !saveDataChanged(sceneImageSource);
+}
+
+bool VulkanRenderer::raymarchNeeded() {
+    if (!settings.computeBackend) return true;
+    // Accumulation keeps marching samples until it converges, then it's the same as the cache
+    if (settings.temporalAccumulation) return !accumulationConverged();
+    return !sceneImageCurrent();
+}
+
+
+// Frame Pacing
+// The present mode is picked in the Renderer panel and the swap chain is recreated when it changes. MAILBOX and
+// IMMEDIATE don't wait for the display, so the CPU limiter can hold them to settings.frameRateLimit instead of drawing
+// as fast as the GPU goes. It sleeps most of the way and spins the rest since sleeps overshoot. Where the driver has
+// VK_GOOGLE_display_timing the time each frame actually reached the display is read back into the stats.
+void VulkanRenderer::paceFrame() {
+    auto now = std::chrono::steady_clock::now();
+    if (settings.frameRateLimit > 0.0f && pacingFrameStartValid) {
+        auto target = pacingFrameStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / settings.frameRateLimit));
+        if (now < target) {
+            auto wake = target - std::chrono::milliseconds(1);
+            if (now < wake) {
+                std::this_thread::sleep_until(wake);
+            }
+            while (std::chrono::steady_clock::now() < target) {
+                std::this_thread::yield();
+            }
+            now = std::chrono::steady_clock::now();
+        }
+    }
+
+    if (pacingFrameStartValid) {
+        stats.cpuFrameTime = std::chrono::duration<float, std::milli>(now - pacingFrameStart).count();
+    }
+    else {
+        frameRateWindowStart = now;
+    }
+    pacingFrameStart = now;
+    pacingFrameStartValid = true;
+
+    frameRateFrames++;
+    float window = std::chrono::duration<float>(now - frameRateWindowStart).count();
+    if (window >= 1.0f) {
+        stats.frameRate = frameRateFrames / window;
+        frameRateFrames = 0;
+        frameRateWindowStart = now;
+    }
+}
+
+// The driver hands back the frames that have reached the display since the last call, oldest first
+void VulkanRenderer::updatePresentTiming() {
+    if (!displayTimingSupported) return;
+
+    uint32_t count = 0;
+    if (getPastPresentationTiming(device, swapChain, &count, nullptr) != VK_SUCCESS || count == 0) return;
+
+    std::vector<VkPastPresentationTimingGOOGLE> timings(count);
+    VkResult result = getPastPresentationTiming(device, swapChain, &count, timings.data());
+    if (result != VK_SUCCESS && result != VK_INCOMPLETE) return;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t actualPresentTime = timings[i].actualPresentTime;
+        // Longer than a second is render on demand sitting idle, not a frame
+        if (lastActualPresentTime != 0 && actualPresentTime > lastActualPresentTime && actualPresentTime - lastActualPresentTime < 1000000000ull) {
+            stats.presentInterval = (actualPresentTime - lastActualPresentTime) / 1000000.0f;
+        }
+        lastActualPresentTime = actualPresentTime;
+    }
+}
+
+
+// Create Frame Buffers
+void VulkanRenderer::createFramebuffers() {
+    swapChainFramebuffers.resize(swapChainImageViews.size());
+
+    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+        std::array<VkImageView, 1> attachments = {
+            swapChainImageViews[i]
+        };
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = swapChainExtent.width;
+        framebufferInfo.height = swapChainExtent.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+}
+
+
+// Create Command Buffers
+void VulkanRenderer::createCommandPool() {
+    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics command pool!");
+    }
+}
+
+void VulkanRenderer::createCommandBuffers() {
+    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+}
+
+// This is the main command list for each draw call, this is probably what will be updated to add new uniforms and stuff
+void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    if (timestampQueryPool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(commandBuffer, timestampQueryPool, currentFrame * 2, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2);
+    }
+    frameRenderScale[currentFrame] = stats.renderScale;
+    frameTiles[currentFrame] = 0;
+
+    bool compute = settings.computeBackend;
+    bool raymarch = raymarchNeeded();
+    frameRaymarched = raymarch;
+    if (raymarch) {
+        recordConePrepass(commandBuffer);
+
+        if (compute) {
+            recordRaymarchDispatch(commandBuffer);
+        }
+    }
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = { 0, 0 };
+    renderPassInfo.renderArea.extent = swapChainExtent;
+
+    std::array<VkClearValue, 1> clearValues{};
+    clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compute ? compositePipeline : currentRaymarchPipeline(false));
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)swapChainExtent.width;
+    viewport.height = (float)swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    // The raymarch or the composite only where ImGui doesn't cover it, ImGui sets its own scissor after
+    vkCmdSetScissor(commandBuffer, 0, 1, &uiVisibleRect);
+
+    VkBuffer vertexBuffers[] = { vertexBuffer };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+
+    if (compute) {
+        CompositeConstants compositeConstants{};
+        compositeConstants.renderSize = glm::vec2(renderExtent.width, renderExtent.height);
+        compositeConstants.targetSize = glm::vec2(swapChainExtent.width, swapChainExtent.height);
+        compositeConstants.edgeAware = settings.edgeAwareUpscale ? 1 : 0;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(CompositeConstants), &compositeConstants);
+    }
+    else {
+        // The fragment backend's only constant, shadows off for the preview tier
+        glm::int32 shadowsOff = previewActive ? 1 : 0;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glm::int32), &shadowsOff);
+    }
+
+    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+
+    // Built by buildUiFrame before waiting on the GPU
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer, 0, NULL);
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    if (timestampQueryPool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2 + 1);
+        frameTimed[currentFrame] = raymarch && !previewActive;
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+
+
+// Builds the ImGui draw data, nothing in here touches the GPU resources of a frame in flight so it runs while the GPU
+// is still busy with the previous ones
+void VulkanRenderer::buildUiFrame() {
+    ImGui_ImplVulkan_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+
+    uiOpaqueRects.clear();
+
+    //ImGui::ShowDemoWindow();
+
+    imgui.drawWindow();
+
+    // Dragging a slider or a drag box changes the world every frame, the same as moving the camera
+    if (ImGui::IsAnyItemActive() && ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+        noteInteraction();
+    }
+
+    ImGui::Render();
+}
+
+
+// Create Synchronization Objects
+// The swap chain still needs binary semaphores for acquire and present, everything the CPU waits on goes through
+// frameTimeline instead of a fence per frame.
+void VulkanRenderer::createSyncObjects() {
+    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    frameTimelineValues.assign(MAX_FRAMES_IN_FLIGHT, 0);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
             throw std::runtime_error("failed to create synchronization objects for a frame!");
         }
     }
+
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo timelineSemaphoreInfo{};
+    timelineSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timelineSemaphoreInfo.pNext = &timelineInfo;
+
+    if (vkCreateSemaphore(device, &timelineSemaphoreInfo, nullptr, &frameTimeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create frame timeline semaphore!");
+    }
+    frameTimelineValue = 0;
+}
+
+// Waits until the current frame's resources are free and at most settings.framesInFlight - 1 frames are still queued.
+// The depth can change between frames, so the slot's own value is waited on as well as the depth one.
+void VulkanRenderer::waitForFrame() {
+    uint64_t depth = static_cast<uint64_t>(std::clamp(settings.framesInFlight, 1, MAX_FRAMES_IN_FLIGHT));
+    uint64_t waitValue = frameTimelineValues[currentFrame];
+    if (frameTimelineValue >= depth) {
+        waitValue = std::max(waitValue, frameTimelineValue + 1 - depth);
+    }
+    if (waitValue == 0) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &frameTimeline;
+    waitInfo.pValues = &waitValue;
+
+    if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for frame timeline semaphore!");
+    }
 }
 
 
@@ -4033,6 +5443,13 @@ void VulkanRenderer::transitionImageLayout(VkImage image, VkFormat format, VkIma
         sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
         destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
     }
+    else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_GENERAL) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
     else {
         throw std::invalid_argument("unsupported layout transition!");
     }
@@ -4154,11 +5571,13 @@ void VulkanRenderer::createTextureImage(const std::string& texturePath, size_t i
     memcpy(data, pixels, static_cast<size_t>(imageSize));
     vkUnmapMemory(device, stagingBufferMemory);
 
-    stbi_image_free(pixels);
-
     // Cleanup previous texture at this index
     cleanupTexture(index);
 
+    createBumpDerivativeImage(pixels, texWidth, texHeight, index);
+
+    stbi_image_free(pixels);
+
     // Create new image for this texture
     createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage[index], textureImageMemory[index]);
 
@@ -4173,6 +5592,55 @@ void VulkanRenderer::createTextureImage(const std::string& texturePath, size_t i
 
 void VulkanRenderer::createTextureImageView(size_t index) {
     imageView[index] = createImageView(textureImage[index], VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+    bumpImageView[index] = createImageView(bumpImage[index], VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+}
+
+// Every texture can be picked as a bump map, so its height derivatives are baked here once instead of being
+// differenced in the shader. The normal bump mode then needs one fetch per triplanar projection at the hit.
+void VulkanRenderer::createBumpDerivativeImage(const stbi_uc* pixels, int texWidth, int texHeight, size_t index) {
+    // The shader reads bump heights from the red channel of an sRGB texture, so linearize before differencing
+    std::array<float, 256> srgbToLinear;
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.0f;
+        srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    auto height = [&](int x, int y) {
+        x = (x + texWidth) % texWidth;
+        y = (y + texHeight) % texHeight;
+        return srgbToLinear[pixels[(static_cast<size_t>(y) * texWidth + x) * 4]];
+    };
+
+    // Central differences in height per texel, wrapping like the repeat sampler
+    std::vector<uint16_t> derivatives(static_cast<size_t>(texWidth) * texHeight * 2);
+    for (int y = 0; y < texHeight; y++) {
+        for (int x = 0; x < texWidth; x++) {
+            size_t texel = (static_cast<size_t>(y) * texWidth + x) * 2;
+            derivatives[texel] = glm::packHalf1x16((height(x + 1, y) - height(x - 1, y)) * 0.5f);
+            derivatives[texel + 1] = glm::packHalf1x16((height(x, y + 1) - height(x, y - 1)) * 0.5f);
+        }
+    }
+
+    VkDeviceSize imageSize = derivatives.size() * sizeof(uint16_t);
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+    memcpy(data, derivatives.data(), static_cast<size_t>(imageSize));
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, bumpImage[index], bumpImageMemory[index]);
+
+    transitionImageLayout(bumpImage[index], VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+    copyBufferToImage(stagingBuffer, bumpImage[index], static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+
+    // Averaging derivatives is the same as differencing the averaged heights, so the usual blit chain works
+    generateMipmaps(bumpImage[index], VK_FORMAT_R16G16_SFLOAT, texWidth, texHeight, mipLevels);
 }
 
 void VulkanRenderer::createTextureSampler() {
@@ -4219,43 +5687,19 @@ void VulkanRenderer::cleanupTexture(size_t index) {
     vkDestroySampler(device, textureSampler, nullptr);
     vkDestroyImage(device, textureImage[index], nullptr);
     vkFreeMemory(device, textureImageMemory[index], nullptr);
-}
-
-
-// Create Depth Buffer
-void VulkanRenderer::createDepthResources() {
-    VkFormat depthFormat = findDepthFormat();
 
-    createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
-    depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-}
-
-VkFormat VulkanRenderer::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
-    for (VkFormat format : candidates) {
-        VkFormatProperties props;
-        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
-
-        if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
-            return format;
-        }
-        else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
-            return format;
-        }
-    }
-
-    throw std::runtime_error("failed to find supported format!");
-}
+    vkDestroyImageView(device, bumpImageView[index], nullptr);
+    vkDestroyImage(device, bumpImage[index], nullptr);
+    vkFreeMemory(device, bumpImageMemory[index], nullptr);
 
-VkFormat VulkanRenderer::findDepthFormat() {
-    return findSupportedFormat(
-        { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-    );
-}
-
-bool VulkanRenderer::hasStencilComponent(VkFormat format) {
-    return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+    // swapTexture cleans up before createTextureImage does it again, so don't leave dangling handles behind
+    imageView[index] = VK_NULL_HANDLE;
+    textureSampler = VK_NULL_HANDLE;
+    textureImage[index] = VK_NULL_HANDLE;
+    textureImageMemory[index] = VK_NULL_HANDLE;
+    bumpImageView[index] = VK_NULL_HANDLE;
+    bumpImage[index] = VK_NULL_HANDLE;
+    bumpImageMemory[index] = VK_NULL_HANDLE;
 }
 
 
@@ -4390,30 +5834,6 @@ void VulkanRenderer::generateMipmaps(VkImage image, VkFormat imageFormat, int32_
 }
 
 
-// Setup Multisampling
-VkSampleCountFlagBits VulkanRenderer::getMaxUsableSampleCount() {
-    VkPhysicalDeviceProperties physicalDeviceProperties;
-    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
-
-    VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
-    if (counts & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
-    if (counts & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
-    if (counts & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
-    if (counts & VK_SAMPLE_COUNT_8_BIT) { return VK_SAMPLE_COUNT_8_BIT; }
-    if (counts & VK_SAMPLE_COUNT_4_BIT) { return VK_SAMPLE_COUNT_4_BIT; }
-    if (counts & VK_SAMPLE_COUNT_2_BIT) { return VK_SAMPLE_COUNT_2_BIT; }
-
-    return VK_SAMPLE_COUNT_1_BIT;
-}
-
-void VulkanRenderer::createColorResources() {
-    VkFormat colorFormat = swapChainImageFormat;
-
-    createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemory);
-    colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-}
-
-
 // Create Vertex Buffer - Not Really Needed for a Path Tracer
 void VulkanRenderer::createVertexBuffer() {
     VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
@@ -4512,14 +5932,21 @@ void VulkanRenderer::createDescriptorSetLayout() {
     cameraLayoutBinding.descriptorCount = 1;
     cameraLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     cameraLayoutBinding.pImmutableSamplers = nullptr;
-    cameraLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    cameraLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     VkDescriptorSetLayoutBinding worldObjectsLayoutBinding{};
     worldObjectsLayoutBinding.binding = 1;
     worldObjectsLayoutBinding.descriptorCount = 1;
     worldObjectsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     worldObjectsLayoutBinding.pImmutableSamplers = nullptr;
-    worldObjectsLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    worldObjectsLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding worldBVHLayoutBinding{};
+    worldBVHLayoutBinding.binding = 2;
+    worldBVHLayoutBinding.descriptorCount = 1;
+    worldBVHLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    worldBVHLayoutBinding.pImmutableSamplers = nullptr;
+    worldBVHLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
     /*
     VkDescriptorSetLayoutBinding worldModifiersLayoutBinding{};
     worldModifiersLayoutBinding.binding = 2;
@@ -4544,15 +5971,99 @@ void VulkanRenderer::createDescriptorSetLayout() {
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     */
 
+    VkDescriptorSetLayoutBinding coneDepthLayoutBinding{};
+    coneDepthLayoutBinding.binding = 3;
+    coneDepthLayoutBinding.descriptorCount = 1;
+    coneDepthLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    coneDepthLayoutBinding.pImmutableSamplers = nullptr;
+    coneDepthLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
     VkDescriptorSetLayoutBinding samplerLayoutBinding{};
     samplerLayoutBinding.binding = 4;
     samplerLayoutBinding.descriptorCount = MAX_IMAGES;  // Set max images
     samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerLayoutBinding.pImmutableSamplers = nullptr;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-
-    std::array<VkDescriptorSetLayoutBinding, 3> bindings = { cameraLayoutBinding, worldObjectsLayoutBinding, /* worldModifiersLayoutBinding, worldIndicesLayoutBinding,*/ samplerLayoutBinding};
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding bumpSamplerLayoutBinding{};
+    bumpSamplerLayoutBinding.binding = 5;
+    bumpSamplerLayoutBinding.descriptorCount = MAX_IMAGES;
+    bumpSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bumpSamplerLayoutBinding.pImmutableSamplers = nullptr;
+    bumpSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+
+    VkDescriptorSetLayoutBinding raymarchImageLayoutBinding{};
+    raymarchImageLayoutBinding.binding = 6;
+    raymarchImageLayoutBinding.descriptorCount = 1;
+    raymarchImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    raymarchImageLayoutBinding.pImmutableSamplers = nullptr;
+    raymarchImageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding raymarchSamplerLayoutBinding{};
+    raymarchSamplerLayoutBinding.binding = 7;
+    raymarchSamplerLayoutBinding.descriptorCount = 1;
+    raymarchSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    raymarchSamplerLayoutBinding.pImmutableSamplers = nullptr;
+    raymarchSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutBinding historyImageLayoutBinding{};
+    historyImageLayoutBinding.binding = 8;
+    historyImageLayoutBinding.descriptorCount = 1;
+    historyImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    historyImageLayoutBinding.pImmutableSamplers = nullptr;
+    historyImageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding reprojectionImageALayoutBinding{};
+    reprojectionImageALayoutBinding.binding = 9;
+    reprojectionImageALayoutBinding.descriptorCount = 1;
+    reprojectionImageALayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    reprojectionImageALayoutBinding.pImmutableSamplers = nullptr;
+    reprojectionImageALayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding reprojectionImageBLayoutBinding{};
+    reprojectionImageBLayoutBinding.binding = 10;
+    reprojectionImageBLayoutBinding.descriptorCount = 1;
+    reprojectionImageBLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    reprojectionImageBLayoutBinding.pImmutableSamplers = nullptr;
+    reprojectionImageBLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding objectIdImageLayoutBinding{};
+    objectIdImageLayoutBinding.binding = 11;
+    objectIdImageLayoutBinding.descriptorCount = 1;
+    objectIdImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    objectIdImageLayoutBinding.pImmutableSamplers = nullptr;
+    objectIdImageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding depthSeedImageLayoutBinding{};
+    depthSeedImageLayoutBinding.binding = 12;
+    depthSeedImageLayoutBinding.descriptorCount = 1;
+    depthSeedImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    depthSeedImageLayoutBinding.pImmutableSamplers = nullptr;
+    depthSeedImageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding gBufferImageLayoutBinding{};
+    gBufferImageLayoutBinding.binding = 13;
+    gBufferImageLayoutBinding.descriptorCount = 1;
+    gBufferImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    gBufferImageLayoutBinding.pImmutableSamplers = nullptr;
+    gBufferImageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding gBufferIdImageLayoutBinding{};
+    gBufferIdImageLayoutBinding.binding = 14;
+    gBufferIdImageLayoutBinding.descriptorCount = 1;
+    gBufferIdImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    gBufferIdImageLayoutBinding.pImmutableSamplers = nullptr;
+    gBufferIdImageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding lightingImageLayoutBinding{};
+    lightingImageLayoutBinding.binding = 15;
+    lightingImageLayoutBinding.descriptorCount = 1;
+    lightingImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    lightingImageLayoutBinding.pImmutableSamplers = nullptr;
+    lightingImageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 16> bindings = { cameraLayoutBinding, worldObjectsLayoutBinding, worldBVHLayoutBinding, /* worldIndicesLayoutBinding,*/ coneDepthLayoutBinding, samplerLayoutBinding, bumpSamplerLayoutBinding, raymarchImageLayoutBinding, raymarchSamplerLayoutBinding, historyImageLayoutBinding, reprojectionImageALayoutBinding, reprojectionImageBLayoutBinding, objectIdImageLayoutBinding, depthSeedImageLayoutBinding, gBufferImageLayoutBinding, gBufferIdImageLayoutBinding, lightingImageLayoutBinding};
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -4566,15 +6077,20 @@ void VulkanRenderer::createDescriptorSetLayout() {
 void VulkanRenderer::createUniformBuffers() {
     VkDeviceSize cameraBufferSize = sizeof(CameraData);
     VkDeviceSize worldBufferSize = sizeof(WorldObjectsData);
+    VkDeviceSize worldBVHBufferSize = sizeof(WorldBVHData);
     //VkDeviceSize worldModifiersBufferSize = sizeof(WorldModifiersData);
     //VkDeviceSize worldIndicesBufferSize = sizeof(WorldIndicesData);
 
     cameraUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
     cameraUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    cameraUniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
     worldObjectsUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
     worldObjectsUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
 
+    worldBVHUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    worldBVHUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+
     //worldModifiersUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
     //worldModifiersUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
 
@@ -4583,7 +6099,9 @@ void VulkanRenderer::createUniformBuffers() {
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         createBuffer(cameraBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cameraUniformBuffers[i], cameraUniformBuffersMemory[i]);
+        vkMapMemory(device, cameraUniformBuffersMemory[i], 0, cameraBufferSize, 0, &cameraUniformBuffersMapped[i]);
         createBuffer(worldBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, worldObjectsUniformBuffers[i], worldObjectsUniformBuffersMemory[i]);
+        createBuffer(worldBVHBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, worldBVHUniformBuffers[i], worldBVHUniformBuffersMemory[i]);
         //createBuffer(worldModifiersBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, worldModifiersUniformBuffers[i], worldModifiersUniformBuffersMemory[i]);
         //createBuffer(worldIndicesBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, worldIndicesUniformBuffers[i], worldIndicesUniformBuffersMemory[i]);
     }
@@ -4591,14 +6109,16 @@ void VulkanRenderer::createUniformBuffers() {
 
 void VulkanRenderer::updateUniformBuffer(uint32_t currentImage) {
     void* data;
-    vkMapMemory(device, cameraUniformBuffersMemory[currentImage], 0, sizeof(CameraData), 0, &data);
-    memcpy(data, &saveData->camData, sizeof(CameraData));
-    vkUnmapMemory(device, cameraUniformBuffersMemory[currentImage]);
+    updateCameraBuffer(currentImage);
 
     vkMapMemory(device, worldObjectsUniformBuffersMemory[currentImage], 0, sizeof(WorldObjectsData), 0, &data);
     memcpy(data, &saveData->worldData, sizeof(WorldObjectsData));
     vkUnmapMemory(device, worldObjectsUniformBuffersMemory[currentImage]);
 
+    vkMapMemory(device, worldBVHUniformBuffersMemory[currentImage], 0, sizeof(WorldBVHData), 0, &data);
+    memcpy(data, &worldBVHData, sizeof(WorldBVHData));
+    vkUnmapMemory(device, worldBVHUniformBuffersMemory[currentImage]);
+
     //vkMapMemory(device, worldModifiersUniformBuffersMemory[currentImage], 0, sizeof(WorldModifiersData), 0, &data);
     //memcpy(data, worldModifiersData, sizeof(WorldModifiersData));
     //vkUnmapMemory(device, worldModifiersUniformBuffersMemory[currentImage]);
@@ -4609,12 +6129,381 @@ void VulkanRenderer::updateUniformBuffer(uint32_t currentImage) {
     
 }
 
+void VulkanRenderer::updateCameraBuffer(uint32_t currentImage) {
+    // The shader's resolution is the part that gets raymarched
+    CameraData camData = saveData->camData;
+    camData.resolution = glm::vec2(renderExtent.width, renderExtent.height);
+    if (previewActive) {
+        camData.num_steps = std::min(camData.num_steps, std::max(settings.previewSteps, 1));
+        camData.ray_depth = std::min(camData.ray_depth, 1);
+    }
+    memcpy(cameraUniformBuffersMapped[currentImage], &camData, sizeof(CameraData));
+}
+
+// Late Latch
+// The command buffer only points at the camera buffer, so the pose can still change after recording. Right before the
+// submit main.cpp gets to take in the input that came in since the frame started and the camera buffer is written
+// again. Only a frame that marches its first sample can take it, an accumulating frame would average the new pose
+// into samples of the old one and a cached frame doesn't read the camera at all, those leave the input for the next
+// frame. Everything that remembers what was drawn is moved to the latched pose too.
+void VulkanRenderer::setCameraLatch(void (*latch)()) {
+    cameraLatch = latch;
+}
+
+void VulkanRenderer::latchCamera() {
+    if (!settings.lateLatchCamera || cameraLatch == nullptr || !frameRaymarched) return;
+    if (settings.computeBackend && settings.temporalAccumulation && raymarchConstants.sampleIndex != 0) return;
+    // The tiles already in from earlier frames were marched with the old pose
+    if (settings.computeBackend && settings.progressiveTiles && progressiveFrameFirstTile != 0) return;
+
+    glm::vec3 cameraPos = saveData->camData.camera_pos;
+    glm::vec3 cameraRot = saveData->camData.camera_rot;
+    cameraLatch();
+    if (saveData->camData.camera_pos == cameraPos && saveData->camData.camera_rot == cameraRot) return;
+
+    for (CameraData* camData : { &drawnSaveData.camData, &accumulationSource.camData, &sceneImageSource.camData, &progressiveSource.camData, &reprojectionSource.camData }) {
+        camData->camera_pos = saveData->camData.camera_pos;
+        camData->camera_rot = saveData->camData.camera_rot;
+    }
+    updateCameraBuffer(currentFrame);
+}
+
+// Only rebuild the BVH, the specialization sizes and the scene shader when the world, or the bump height that pads the bounds, changed.
+// This is CPU only, updateUniformBuffer copies the result once the frame's buffers are free.
+void VulkanRenderer::updateWorldBVH() {
+    if (!worldBVHValid || worldBVHBumpHeight != saveData->camData.data3.y || memcmp(&worldBVHSource, &saveData->worldData, sizeof(WorldObjectsData)) != 0) {
+        buildWorldBVH();
+        updateWorldSpecialization();
+        sceneShaderSource = generateSceneShader();
+        memcpy(&worldBVHSource, &saveData->worldData, sizeof(WorldObjectsData));
+        worldBVHBumpHeight = saveData->camData.data3.y;
+        worldBVHValid = true;
+    }
+}
+
+// World BVH
+// Bounds of the world indices so the shader can skip the ones farther away than the closest distance so far.
+// Everything here is conservative, anything that can't be bounded (planes, infinite repeats, time or camera
+// dependent modifiers) is put on the unbounded list and always evaluated.
+void VulkanRenderer::buildWorldBVH() {
+    worldBVHData = {};
+
+    glm::vec3 leafMin[MAX_OBJECTS];
+    glm::vec3 leafMax[MAX_OBJECTS];
+    std::vector<int> leaves;
+
+    int numIndices = std::min(std::max(saveData->worldData.num_indices, 0), MAX_OBJECTS);
+    for (int i = 0; i < numIndices; i++) {
+        if (boundWorldIndexTree(saveData->worldData.indices[i].type, saveData->worldData.indices[i].index, leafMin[i], leafMax[i], 0)) {
+            leaves.push_back(i);
+        }
+        else {
+            worldBVHData.unbounded[worldBVHData.num_unbounded / 4][worldBVHData.num_unbounded % 4] = i;
+            worldBVHData.num_unbounded++;
+        }
+    }
+
+    if (!leaves.empty()) {
+        buildWorldBVHNode(leaves, 0, leaves.size(), leafMin, leafMax);
+    }
+}
+
+int VulkanRenderer::buildWorldBVHNode(std::vector<int>& leaves, size_t begin, size_t end, const glm::vec3* leafMin, const glm::vec3* leafMax) {
+    int nodeIndex = worldBVHData.num_nodes++;
+    WorldBVHNode& node = worldBVHData.nodes[nodeIndex];
+
+    glm::vec3 boundsMin = leafMin[leaves[begin]];
+    glm::vec3 boundsMax = leafMax[leaves[begin]];
+    glm::vec3 centerMin = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 centerMax = centerMin;
+    for (size_t i = begin + 1; i < end; i++) {
+        boundsMin = glm::min(boundsMin, leafMin[leaves[i]]);
+        boundsMax = glm::max(boundsMax, leafMax[leaves[i]]);
+        centerMin = glm::min(centerMin, (leafMin[leaves[i]] + leafMax[leaves[i]]) * 0.5f);
+        centerMax = glm::max(centerMax, (leafMin[leaves[i]] + leafMax[leaves[i]]) * 0.5f);
+    }
+    node.boundsMin = glm::vec4(boundsMin, 0.0f);
+    node.boundsMax = glm::vec4(boundsMax, 0.0f);
+
+    if (end - begin == 1) {
+        node.left = -1;
+        node.right = -1;
+        node.index = leaves[begin];
+        return nodeIndex;
+    }
+
+    // Median split along the axis the leaf centers are spread the most
+    glm::vec3 spread = centerMax - centerMin;
+    int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+    size_t mid = (begin + end) / 2;
+    std::nth_element(leaves.begin() + begin, leaves.begin() + mid, leaves.begin() + end, [&](int a, int b) {
+        return leafMin[a][axis] + leafMax[a][axis] < leafMin[b][axis] + leafMax[b][axis];
+    });
+
+    node.index = -1;
+    int left = buildWorldBVHNode(leaves, begin, mid, leafMin, leafMax);
+    int right = buildWorldBVHNode(leaves, mid, end, leafMin, leafMax);
+    worldBVHData.nodes[nodeIndex].left = left;
+    worldBVHData.nodes[nodeIndex].right = right;
+    return nodeIndex;
+}
+
+bool VulkanRenderer::boundWorldObject(int index, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+    if (index < 0 || index >= MAX_OBJECTS) {
+        return false;
+    }
+    const WorldObject& object = saveData->worldData.objects[index];
+    glm::vec3 size = glm::abs(object.size);
+
+    // Same parameters as map_the_object, extents are relative to the center
+    glm::vec3 extentMin;
+    glm::vec3 extentMax;
+    switch (object.type) {
+    case 2: // Sphere
+        extentMax = glm::vec3(size.x);
+        extentMin = -extentMax;
+        break;
+    case 3: // Box
+        extentMax = size;
+        extentMin = -extentMax;
+        break;
+    case 7: // Cylinder
+        extentMax = glm::vec3(size.x, size.y, size.x);
+        extentMin = -extentMax;
+        break;
+    case 8: // Capsule
+        extentMax = glm::vec3(size.x, size.y + size.x, size.x);
+        extentMin = -extentMax;
+        break;
+    case 9: // Torus
+        extentMax = glm::vec3(size.x + size.y, size.x, size.x + size.y);
+        extentMin = -extentMax;
+        break;
+    case 10: // Circle
+    case 11: // Disc
+        extentMax = glm::vec3(size.x, 0.0f, size.x);
+        extentMin = -extentMax;
+        break;
+    case 12: // Hexagon Circumcircle
+    case 13: // Hexagon Incircle
+        extentMax = glm::vec3(size.x * 1.1548f, size.y, size.x * 1.1548f); // 2 / sqrt(3), corner of the circumcircle hexagon
+        extentMin = -extentMax;
+        break;
+    case 14: // Cone, base at the center, tip at height
+        extentMax = glm::vec3(size.x, std::max(object.size.y, 0.0f), size.x);
+        extentMin = glm::vec3(-size.x, std::min(object.size.y, 0.0f), -size.x);
+        break;
+    default:
+        return false;
+    }
+
+    // Displacement bump mapping can grow the object by up to the bump height when it's negative
+    float margin = 0.0f;
+    if (object.int3 != 0 && object.int5 == 0) {
+        margin = std::max(-saveData->camData.data3.y, 0.0f);
+    }
+
+    boundsMin = object.center + extentMin - margin;
+    boundsMax = object.center + extentMax + margin;
+    return true;
+}
+
+static void rotateBoundsPoint(float& x, float& y, float a) {
+    // Same as pR in the shader
+    float rx = cos(a) * x + sin(a) * y;
+    float ry = cos(a) * y - sin(a) * x;
+    x = rx;
+    y = ry;
+}
+
+// Bounds of one index tree in the space it is evaluated in, false if it can't be bounded
+bool VulkanRenderer::boundWorldIndexTree(int type, int index, glm::vec3& boundsMin, glm::vec3& boundsMax, int depth) {
+    if (depth >= MAX_OBJECTS || index < 0 || index >= MAX_OBJECTS) {
+        return false;
+    }
+
+    if (type == 1) {
+        return boundWorldObject(index, boundsMin, boundsMax);
+    }
+    else if (type == 2) {
+        const WorldObjectCombineModifier& modifier = saveData->worldData.combineModifiers[index];
+        glm::vec3 min1, max1, min2, max2;
+        bool bounded1 = boundWorldIndexTree(modifier.index1Type, modifier.index1, min1, max1, depth + 1);
+        bool bounded2 = boundWorldObject(modifier.index2, min2, max2);
+        float radius = std::abs(modifier.data1.x);
+
+        switch (modifier.type) {
+        case 1:  // Union
+        case 4:  // Union Chamfer
+        case 7:  // Union Round
+        case 10: // Union Columns
+        case 13: // Union Stairs
+        case 16: // Union Soft
+            // The blends only add material where both sides are within the radius
+            if (!bounded1 || !bounded2) return false;
+            boundsMin = glm::min(min1, min2) - radius;
+            boundsMax = glm::max(max1, max2) + radius;
+            return true;
+        case 11: // Intersection Columns
+        case 17: // Pipe
+            min1 -= radius; max1 += radius;
+            min2 -= radius; max2 += radius;
+            [[fallthrough]];
+        case 2:  // Intersection
+        case 5:  // Intersection Chamfer
+        case 8:  // Intersection Round
+        case 14: // Intersection Stairs
+            if (bounded1 && bounded2) {
+                boundsMin = glm::max(min1, min2);
+                boundsMax = glm::max(glm::min(max1, max2), boundsMin);
+            }
+            else if (bounded1 || bounded2) {
+                boundsMin = bounded1 ? min1 : min2;
+                boundsMax = bounded1 ? max1 : max2;
+            }
+            else {
+                return false;
+            }
+            return true;
+        case 12: // Difference Columns
+        case 20: // Tongue
+            min1 -= radius; max1 += radius;
+            [[fallthrough]];
+        case 3:  // Difference
+        case 6:  // Difference Chamfer
+        case 9:  // Difference Round
+        case 15: // Difference Stairs
+        case 18: // Engrave
+        case 19: // Groove
+            if (!bounded1) return false;
+            boundsMin = min1;
+            boundsMax = max1;
+            return true;
+        case 21: // Bounding box, the chain only has a surface within data1.x of the box object
+            if (!bounded2) {
+                if (!bounded1) return false;
+                boundsMin = min1;
+                boundsMax = max1;
+                return true;
+            }
+            boundsMin = min2 - modifier.data1.x;
+            boundsMax = max2 + modifier.data1.x;
+            if (bounded1) {
+                boundsMin = glm::max(boundsMin, min1);
+                boundsMax = glm::max(glm::min(boundsMax, max1), boundsMin);
+            }
+            return true;
+        case 22: // Reverse Difference
+            if (!bounded2) return false;
+            boundsMin = min2;
+            boundsMax = max2;
+            return true;
+        default:
+            if (!bounded1) return false;
+            boundsMin = min1;
+            boundsMax = max1;
+            return true;
+        }
+    }
+    else if (type == 3) {
+        const WorldObjectDomainModifier& modifier = saveData->worldData.domainModifiers[index];
+        if (!boundWorldIndexTree(modifier.index1Type, modifier.index1, boundsMin, boundsMax, depth + 1)) {
+            return false;
+        }
+
+        // Map the child's bounds back through the modifier, the inverse of map_the_domain_modifier
+        glm::vec3 data1 = glm::vec3(modifier.data1);
+        glm::vec3 data2 = glm::vec3(modifier.data2);
+        switch (modifier.type) {
+        case 0: // Nothing
+            return true;
+        case 1: // Translate
+            boundsMin += data1;
+            boundsMax += data1;
+            return true;
+        case 2: // Scale
+            for (int k = 0; k < 3; k++) {
+                if (data1[k] != 0) {
+                    float a = boundsMin[k] * data1[k];
+                    float b = boundsMax[k] * data1[k];
+                    boundsMin[k] = std::min(a, b);
+                    boundsMax[k] = std::max(a, b);
+                }
+            }
+            return true;
+        case 3: // Rotate, undo z then y then x
+        case 4: { // Reflect, the mirrored copy joins the original
+            glm::vec3 corners[8];
+            for (int c = 0; c < 8; c++) {
+                corners[c] = glm::vec3(c & 1 ? boundsMax.x : boundsMin.x, c & 2 ? boundsMax.y : boundsMin.y, c & 4 ? boundsMax.z : boundsMin.z);
+            }
+            glm::vec3 newMin = modifier.type == 4 ? boundsMin : glm::vec3(std::numeric_limits<float>::max());
+            glm::vec3 newMax = modifier.type == 4 ? boundsMax : glm::vec3(-std::numeric_limits<float>::max());
+            for (int c = 0; c < 8; c++) {
+                glm::vec3 p = corners[c];
+                if (modifier.type == 3) {
+                    if (data1.z != 0) rotateBoundsPoint(p.x, p.y, -data1.z);
+                    if (data1.y != 0) rotateBoundsPoint(p.x, p.z, -data1.y);
+                    if (data1.x != 0) rotateBoundsPoint(p.y, p.z, -data1.x);
+                }
+                else {
+                    p -= 2.0f * (glm::dot(p, data1) + modifier.data1.w) * data1;
+                }
+                newMin = glm::min(newMin, p);
+                newMax = glm::max(newMax, p);
+            }
+            boundsMin = newMin;
+            boundsMax = newMax;
+            return true;
+        }
+        case 8: // Multiply, copies from cell 0 to data2
+            for (int k = 0; k < 3; k++) {
+                if (data1[k] != 0) {
+                    float shift = data1[k] * data2[k];
+                    boundsMin[k] += std::min(shift, 0.0f);
+                    boundsMax[k] += std::max(shift, 0.0f);
+                }
+            }
+            return true;
+        case 9: // Ring, any angle around the axis
+        case 10: { // Octant, mirrored and swapped on the two axes
+            const int axisA[3] = { 1, 0, 1 };
+            const int axisB[3] = { 2, 2, 0 };
+            for (int k = 2; k >= 0; k--) {
+                if (data1[k] == 0) continue;
+                int a = axisA[k];
+                int b = axisB[k];
+                float extent;
+                if (modifier.type == 9) {
+                    extent = glm::length(glm::vec2(std::max(std::abs(boundsMin[a]), std::abs(boundsMax[a])), std::max(std::abs(boundsMin[b]), std::abs(boundsMax[b]))));
+                }
+                else {
+                    extent = std::max(std::max(std::abs(boundsMin[a]), std::abs(boundsMax[a])), std::max(std::abs(boundsMin[b]), std::abs(boundsMax[b])));
+                    extent += std::max(std::abs(data1[k]), std::abs(data2[k]));
+                }
+                boundsMin[a] = -extent;
+                boundsMin[b] = -extent;
+                boundsMax[a] = extent;
+                boundsMax[b] = extent;
+            }
+            return true;
+        }
+        default:
+            // Repeats are infinite, the rest depend on time or the camera
+            return false;
+        }
+    }
+    return false;
+}
+
 void VulkanRenderer::createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 3;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2 * MAX_IMAGES;
+    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 3 * MAX_IMAGES;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 9;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -4764,15 +6653,64 @@ void VulkanRenderer::createDescriptorSets() {
         worldObjectsBufferInfo.offset = 0;
         worldObjectsBufferInfo.range = sizeof(WorldObjectsData);
 
+        VkDescriptorBufferInfo worldBVHBufferInfo{};
+        worldBVHBufferInfo.buffer = worldBVHUniformBuffers[i];
+        worldBVHBufferInfo.offset = 0;
+        worldBVHBufferInfo.range = sizeof(WorldBVHData);
+
         // Prepare image array
         std::vector<VkDescriptorImageInfo> imageInfos(MAX_IMAGES);
+        std::vector<VkDescriptorImageInfo> bumpImageInfos(MAX_IMAGES);
         for (size_t j = 0; j < MAX_IMAGES; j++) {
             imageInfos[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             imageInfos[j].imageView = imageView[j];  // Assuming imageViews is a vector of VkImageView
             imageInfos[j].sampler = textureSampler;  // Assuming one sampler is reused
+            bumpImageInfos[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            bumpImageInfos[j].imageView = bumpImageView[j];
+            bumpImageInfos[j].sampler = textureSampler;
         }
 
-        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        VkDescriptorImageInfo coneDepthImageInfo{};
+        coneDepthImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        coneDepthImageInfo.imageView = conePrepassImageView;
+        coneDepthImageInfo.sampler = textureSampler;
+
+        VkDescriptorImageInfo raymarchStorageInfo{};
+        raymarchStorageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        raymarchStorageInfo.imageView = raymarchImageView;
+
+        VkDescriptorImageInfo raymarchSamplerInfo{};
+        raymarchSamplerInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        raymarchSamplerInfo.imageView = raymarchImageView;
+        raymarchSamplerInfo.sampler = textureSampler;
+
+        VkDescriptorImageInfo historyImageInfo{};
+        historyImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        historyImageInfo.imageView = historyImageView;
+
+        std::array<VkDescriptorImageInfo, 2> reprojectionImageInfos{};
+        for (size_t j = 0; j < reprojectionImageInfos.size(); j++) {
+            reprojectionImageInfos[j].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            reprojectionImageInfos[j].imageView = reprojectionImageViews[j];
+        }
+
+        VkDescriptorImageInfo objectIdImageInfo{};
+        objectIdImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        objectIdImageInfo.imageView = objectIdImageView;
+
+        VkDescriptorImageInfo depthSeedImageInfo{};
+        depthSeedImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        depthSeedImageInfo.imageView = depthSeedImageView;
+
+        std::array<VkDescriptorImageInfo, 3> gBufferImageInfos{};
+        gBufferImageInfos[0].imageView = gBufferImageView;
+        gBufferImageInfos[1].imageView = gBufferIdImageView;
+        gBufferImageInfos[2].imageView = lightingImageView;
+        for (size_t j = 0; j < gBufferImageInfos.size(); j++) {
+            gBufferImageInfos[j].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        std::array<VkWriteDescriptorSet, 16> descriptorWrites{};
 
         descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[0].dstSet = descriptorSets[i];
@@ -4793,6 +6731,95 @@ void VulkanRenderer::createDescriptorSets() {
         descriptorWrites[2].descriptorCount = static_cast<uint32_t>(imageInfos.size());
         descriptorWrites[2].pImageInfo = imageInfos.data();
 
+        descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[3].dstSet = descriptorSets[i];
+        descriptorWrites[3].dstBinding = 5;  // Binding for bump derivative maps
+        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[3].descriptorCount = static_cast<uint32_t>(bumpImageInfos.size());
+        descriptorWrites[3].pImageInfo = bumpImageInfos.data();
+
+        descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[4].dstSet = descriptorSets[i];
+        descriptorWrites[4].dstBinding = 2;
+        descriptorWrites[4].dstArrayElement = 0;
+        descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[4].descriptorCount = 1;
+        descriptorWrites[4].pBufferInfo = &worldBVHBufferInfo;
+
+        descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[5].dstSet = descriptorSets[i];
+        descriptorWrites[5].dstBinding = 3;
+        descriptorWrites[5].dstArrayElement = 0;
+        descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[5].descriptorCount = 1;
+        descriptorWrites[5].pImageInfo = &coneDepthImageInfo;
+
+        descriptorWrites[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[6].dstSet = descriptorSets[i];
+        descriptorWrites[6].dstBinding = 6;
+        descriptorWrites[6].dstArrayElement = 0;
+        descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[6].descriptorCount = 1;
+        descriptorWrites[6].pImageInfo = &raymarchStorageInfo;
+
+        descriptorWrites[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[7].dstSet = descriptorSets[i];
+        descriptorWrites[7].dstBinding = 7;
+        descriptorWrites[7].dstArrayElement = 0;
+        descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[7].descriptorCount = 1;
+        descriptorWrites[7].pImageInfo = &raymarchSamplerInfo;
+
+        descriptorWrites[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[8].dstSet = descriptorSets[i];
+        descriptorWrites[8].dstBinding = 8;
+        descriptorWrites[8].dstArrayElement = 0;
+        descriptorWrites[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[8].descriptorCount = 1;
+        descriptorWrites[8].pImageInfo = &historyImageInfo;
+
+        descriptorWrites[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[9].dstSet = descriptorSets[i];
+        descriptorWrites[9].dstBinding = 9;
+        descriptorWrites[9].dstArrayElement = 0;
+        descriptorWrites[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[9].descriptorCount = 1;
+        descriptorWrites[9].pImageInfo = &reprojectionImageInfos[0];
+
+        descriptorWrites[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[10].dstSet = descriptorSets[i];
+        descriptorWrites[10].dstBinding = 10;
+        descriptorWrites[10].dstArrayElement = 0;
+        descriptorWrites[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[10].descriptorCount = 1;
+        descriptorWrites[10].pImageInfo = &reprojectionImageInfos[1];
+
+        descriptorWrites[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[11].dstSet = descriptorSets[i];
+        descriptorWrites[11].dstBinding = 11;
+        descriptorWrites[11].dstArrayElement = 0;
+        descriptorWrites[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[11].descriptorCount = 1;
+        descriptorWrites[11].pImageInfo = &objectIdImageInfo;
+
+        descriptorWrites[12].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[12].dstSet = descriptorSets[i];
+        descriptorWrites[12].dstBinding = 12;
+        descriptorWrites[12].dstArrayElement = 0;
+        descriptorWrites[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[12].descriptorCount = 1;
+        descriptorWrites[12].pImageInfo = &depthSeedImageInfo;
+
+        for (size_t j = 0; j < gBufferImageInfos.size(); j++) {
+            descriptorWrites[13 + j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[13 + j].dstSet = descriptorSets[i];
+            descriptorWrites[13 + j].dstBinding = static_cast<uint32_t>(13 + j);
+            descriptorWrites[13 + j].dstArrayElement = 0;
+            descriptorWrites[13 + j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[13 + j].descriptorCount = 1;
+            descriptorWrites[13 + j].pImageInfo = &gBufferImageInfos[j];
+        }
+
         vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
     }
 }
@@ -4809,15 +6836,64 @@ void VulkanRenderer::updateDescriptorSets() {
         worldObjectsBufferInfo.offset = 0;
         worldObjectsBufferInfo.range = sizeof(WorldObjectsData);
 
+        VkDescriptorBufferInfo worldBVHBufferInfo{};
+        worldBVHBufferInfo.buffer = worldBVHUniformBuffers[i];
+        worldBVHBufferInfo.offset = 0;
+        worldBVHBufferInfo.range = sizeof(WorldBVHData);
+
         // Prepare image array for multiple textures
         std::vector<VkDescriptorImageInfo> imageInfos(MAX_IMAGES);
+        std::vector<VkDescriptorImageInfo> bumpImageInfos(MAX_IMAGES);
         for (size_t j = 0; j < MAX_IMAGES; j++) {
             imageInfos[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             imageInfos[j].imageView = imageView[j];  // Assuming imageViews is a vector of VkImageView
             imageInfos[j].sampler = textureSampler;  // Assuming one sampler is reused for all images
+            bumpImageInfos[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            bumpImageInfos[j].imageView = bumpImageView[j];
+            bumpImageInfos[j].sampler = textureSampler;
         }
 
-        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        VkDescriptorImageInfo coneDepthImageInfo{};
+        coneDepthImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        coneDepthImageInfo.imageView = conePrepassImageView;
+        coneDepthImageInfo.sampler = textureSampler;
+
+        VkDescriptorImageInfo raymarchStorageInfo{};
+        raymarchStorageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        raymarchStorageInfo.imageView = raymarchImageView;
+
+        VkDescriptorImageInfo raymarchSamplerInfo{};
+        raymarchSamplerInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        raymarchSamplerInfo.imageView = raymarchImageView;
+        raymarchSamplerInfo.sampler = textureSampler;
+
+        VkDescriptorImageInfo historyImageInfo{};
+        historyImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        historyImageInfo.imageView = historyImageView;
+
+        std::array<VkDescriptorImageInfo, 2> reprojectionImageInfos{};
+        for (size_t j = 0; j < reprojectionImageInfos.size(); j++) {
+            reprojectionImageInfos[j].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            reprojectionImageInfos[j].imageView = reprojectionImageViews[j];
+        }
+
+        VkDescriptorImageInfo objectIdImageInfo{};
+        objectIdImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        objectIdImageInfo.imageView = objectIdImageView;
+
+        VkDescriptorImageInfo depthSeedImageInfo{};
+        depthSeedImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        depthSeedImageInfo.imageView = depthSeedImageView;
+
+        std::array<VkDescriptorImageInfo, 3> gBufferImageInfos{};
+        gBufferImageInfos[0].imageView = gBufferImageView;
+        gBufferImageInfos[1].imageView = gBufferIdImageView;
+        gBufferImageInfos[2].imageView = lightingImageView;
+        for (size_t j = 0; j < gBufferImageInfos.size(); j++) {
+            gBufferImageInfos[j].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        std::array<VkWriteDescriptorSet, 16> descriptorWrites{};
 
         // Camera uniform buffer descriptor
         descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -4846,6 +6922,106 @@ void VulkanRenderer::updateDescriptorSets() {
         descriptorWrites[2].descriptorCount = static_cast<uint32_t>(imageInfos.size());
         descriptorWrites[2].pImageInfo = imageInfos.data();
 
+        // Bump derivative maps, one per texture slot
+        descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[3].dstSet = descriptorSets[i];
+        descriptorWrites[3].dstBinding = 5;  // Binding 5: Combined image sampler
+        descriptorWrites[3].dstArrayElement = 0;
+        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[3].descriptorCount = static_cast<uint32_t>(bumpImageInfos.size());
+        descriptorWrites[3].pImageInfo = bumpImageInfos.data();
+
+        // World index BVH uniform buffer descriptor
+        descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[4].dstSet = descriptorSets[i];
+        descriptorWrites[4].dstBinding = 2;  // Binding 2: World index BVH uniform buffer
+        descriptorWrites[4].dstArrayElement = 0;
+        descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[4].descriptorCount = 1;
+        descriptorWrites[4].pBufferInfo = &worldBVHBufferInfo;
+
+        // Cone prepass start distances
+        descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[5].dstSet = descriptorSets[i];
+        descriptorWrites[5].dstBinding = 3;  // Binding 3: Cone prepass image
+        descriptorWrites[5].dstArrayElement = 0;
+        descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[5].descriptorCount = 1;
+        descriptorWrites[5].pImageInfo = &coneDepthImageInfo;
+
+        // Compute backend output, written by the dispatch
+        descriptorWrites[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[6].dstSet = descriptorSets[i];
+        descriptorWrites[6].dstBinding = 6;  // Binding 6: Raymarch storage image
+        descriptorWrites[6].dstArrayElement = 0;
+        descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[6].descriptorCount = 1;
+        descriptorWrites[6].pImageInfo = &raymarchStorageInfo;
+
+        // Compute backend output, read by the composite
+        descriptorWrites[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[7].dstSet = descriptorSets[i];
+        descriptorWrites[7].dstBinding = 7;  // Binding 7: Raymarch image sampler
+        descriptorWrites[7].dstArrayElement = 0;
+        descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[7].descriptorCount = 1;
+        descriptorWrites[7].pImageInfo = &raymarchSamplerInfo;
+
+        // Temporal accumulation history, read and written by the dispatch
+        descriptorWrites[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[8].dstSet = descriptorSets[i];
+        descriptorWrites[8].dstBinding = 8;  // Binding 8: History storage image
+        descriptorWrites[8].dstArrayElement = 0;
+        descriptorWrites[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[8].descriptorCount = 1;
+        descriptorWrites[8].pImageInfo = &historyImageInfo;
+
+        // Checkerboard reprojection images, the shader picks which is this frame's
+        descriptorWrites[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[9].dstSet = descriptorSets[i];
+        descriptorWrites[9].dstBinding = 9;  // Binding 9: Reprojection storage image A
+        descriptorWrites[9].dstArrayElement = 0;
+        descriptorWrites[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[9].descriptorCount = 1;
+        descriptorWrites[9].pImageInfo = &reprojectionImageInfos[0];
+
+        descriptorWrites[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[10].dstSet = descriptorSets[i];
+        descriptorWrites[10].dstBinding = 10;  // Binding 10: Reprojection storage image B
+        descriptorWrites[10].dstArrayElement = 0;
+        descriptorWrites[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[10].descriptorCount = 1;
+        descriptorWrites[10].pImageInfo = &reprojectionImageInfos[1];
+
+        // Primary hit object of every pixel, next to the reprojection images for the edge supersampling
+        descriptorWrites[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[11].dstSet = descriptorSets[i];
+        descriptorWrites[11].dstBinding = 11;  // Binding 11: Object ID storage image
+        descriptorWrites[11].dstArrayElement = 0;
+        descriptorWrites[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[11].descriptorCount = 1;
+        descriptorWrites[11].pImageInfo = &objectIdImageInfo;
+
+        // Depth seeding splats, written by the splat pass and read by the primary pass
+        descriptorWrites[12].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[12].dstSet = descriptorSets[i];
+        descriptorWrites[12].dstBinding = 12;  // Binding 12: Depth seed storage image
+        descriptorWrites[12].dstArrayElement = 0;
+        descriptorWrites[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[12].descriptorCount = 1;
+        descriptorWrites[12].pImageInfo = &depthSeedImageInfo;
+
+        // Deferred shading's G-buffer, ID and lighting images
+        for (size_t j = 0; j < gBufferImageInfos.size(); j++) {
+            descriptorWrites[13 + j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[13 + j].dstSet = descriptorSets[i];
+            descriptorWrites[13 + j].dstBinding = static_cast<uint32_t>(13 + j);  // Bindings 13-15: G-buffer storage images
+            descriptorWrites[13 + j].dstArrayElement = 0;
+            descriptorWrites[13 + j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[13 + j].descriptorCount = 1;
+            descriptorWrites[13 + j].pImageInfo = &gBufferImageInfos[j];
+        }
+
         // Update the descriptor sets
         vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
     }
@@ -4864,8 +7040,22 @@ void VulkanRenderer::mainLoop() {
 
 
 // Draw Frame
+// The UI and the uniform data are built on the CPU before waiting, so with more than one frame in flight they overlap
+// the GPU work of the frames before. Only the parts that write this frame's buffers or read its timestamps wait.
 void VulkanRenderer::drawFramePrivate() {
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    paceFrame();
+
+    // The present mode was changed in the Renderer panel
+    if (settings.presentMode != swapChainPresentModeSetting) {
+        recreateSwapChain();
+    }
+
+    buildUiFrame();
+    updateGBufferImages();
+    updateWorldBVH();
+    updateSceneShader();
+
+    waitForFrame();
 
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -4878,13 +7068,32 @@ void VulkanRenderer::drawFramePrivate() {
         throw std::runtime_error("failed to acquire swap chain image!");
     }
 
+    memcpy(&drawnSaveData, saveData, sizeof(SaveData));
+    drawnSaveDataValid = true;
+    if (redrawFrames > 0) redrawFrames--;
+
+    updateInteractionPreview();
+    updateRenderScale();
+    updateRaymarchRect();
+    updateAccumulation();
     updateUniformBuffer(currentFrame);
     recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    latchCamera();
+
+    frameTimelineValue++;
+    frameTimelineValues[currentFrame] = frameTimelineValue;
 
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    // The binary semaphore's value is ignored, it's only there so the arrays line up
+    uint64_t signalValues[] = { 0, frameTimelineValue };
+
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+    timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineSubmitInfo.signalSemaphoreValueCount = 2;
+    timelineSubmitInfo.pSignalSemaphoreValues = signalValues;
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineSubmitInfo;
 
     VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
     VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
@@ -4895,11 +7104,11 @@ void VulkanRenderer::drawFramePrivate() {
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
-    VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-    submitInfo.signalSemaphoreCount = 1;
+    VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame], frameTimeline };
+    submitInfo.signalSemaphoreCount = 2;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
         throw std::runtime_error("failed to submit draw command buffer!");
     }
 
@@ -4915,6 +7124,19 @@ void VulkanRenderer::drawFramePrivate() {
 
     presentInfo.pImageIndices = &imageIndex;
 
+    // Tagged so updatePresentTiming can read back when it reached the display, as soon as possible is fine
+    VkPresentTimeGOOGLE presentTime{};
+    presentTime.presentID = ++presentID;
+    presentTime.desiredPresentTime = 0;
+
+    VkPresentTimesInfoGOOGLE presentTimesInfo{};
+    presentTimesInfo.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE;
+    presentTimesInfo.swapchainCount = 1;
+    presentTimesInfo.pTimes = &presentTime;
+    if (displayTimingSupported) {
+        presentInfo.pNext = &presentTimesInfo;
+    }
+
     result = vkQueuePresentKHR(presentQueue, &presentInfo);
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
@@ -4924,8 +7146,11 @@ void VulkanRenderer::drawFramePrivate() {
     else if (result != VK_SUCCESS) {
         throw std::runtime_error("failed to present swap chain image!");
     }
+    else {
+        updatePresentTiming();
+    }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % std::clamp(settings.framesInFlight, 1, MAX_FRAMES_IN_FLIGHT);
 }
     
 
@@ -4941,15 +7166,33 @@ void VulkanRenderer::cleanup() {
 
     cleanupSwapChain();
 
+    if (sceneShaderThread.joinable()) {
+        sceneShaderThread.join();
+    }
+    if (sceneShaderCompiledPipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, sceneShaderCompiledPipeline, nullptr);
+    }
+    if (sceneComputeShaderCompiledPipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, sceneComputeShaderCompiledPipeline, nullptr);
+    }
+    for (const RaymarchPipelineVariant& variant : raymarchPipelineVariants) {
+        vkDestroyPipeline(device, variant.pipeline, nullptr);
+    }
     vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    vkDestroyPipeline(device, conePrepassPipeline, nullptr);
+    vkDestroyPipeline(device, computePipeline, nullptr);
+    vkDestroyPipeline(device, compositePipeline, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyRenderPass(device, renderPass, nullptr);
+    vkDestroyRenderPass(device, conePrepassRenderPass, nullptr);
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroyBuffer(device, cameraUniformBuffers[i], nullptr);
         vkFreeMemory(device, cameraUniformBuffersMemory[i], nullptr);
         vkDestroyBuffer(device, worldObjectsUniformBuffers[i], nullptr);
         vkFreeMemory(device, worldObjectsUniformBuffersMemory[i], nullptr);
+        vkDestroyBuffer(device, worldBVHUniformBuffers[i], nullptr);
+        vkFreeMemory(device, worldBVHUniformBuffersMemory[i], nullptr);
     }
 
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
@@ -4959,6 +7202,9 @@ void VulkanRenderer::cleanup() {
         vkDestroyImageView(device, imageView[i], nullptr);
         vkDestroyImage(device, textureImage[i], nullptr);
         vkFreeMemory(device, textureImageMemory[i], nullptr);
+        vkDestroyImageView(device, bumpImageView[i], nullptr);
+        vkDestroyImage(device, bumpImage[i], nullptr);
+        vkFreeMemory(device, bumpImageMemory[i], nullptr);
     }
 
     vkDestroySampler(device, textureSampler, nullptr);
@@ -4979,7 +7225,11 @@ void VulkanRenderer::cleanup() {
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
         vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-        vkDestroyFence(device, inFlightFences[i], nullptr);
+    }
+    vkDestroySemaphore(device, frameTimeline, nullptr);
+
+    if (timestampQueryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, timestampQueryPool, nullptr);
     }
 
     vkDestroyCommandPool(device, commandPool, nullptr);
@@ -9,6 +9,7 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #ifndef VULKANIMPORTS
 #define VULKANIMPORTS
@@ -40,10 +41,13 @@
 #include <cstdlib>
 #include <cstdint>
 #include <limits>
+#include <cmath>
 #include <array>
 #include <optional>
 #include <set>
 #include <unordered_map>
+#include <thread>
+#include <atomic>
 #include <stdio.h>
 #include <filesystem>
 #undef snprintf
@@ -195,6 +199,52 @@ private:
 };
 
 
+// Tile size of the cone prepass in pixels, has to match CONE_TILE_SIZE in shader.frag
+#define CONE_PREPASS_TILE_SIZE 8
+
+// Renderer options, not part of the saved worlds
+struct RendererSettings {
+    bool conePrepass = true;
+    bool computeBackend = true; // Raymarch in a compute shader and composite, otherwise in the full screen fragment shader
+    bool dynamicResolution = true; // Compute backend only
+    float targetFrameTime = 16.6f; // Milliseconds of GPU time per frame
+    float minRenderScale = 0.5f;
+    bool edgeAwareUpscale = false;
+    bool temporalAccumulation = true; // Compute backend only
+    int maxAccumulatedSamples = 256;  // The raymarch stops once the history has this many
+    bool renderOnDemand = true;       // Only draw when something on screen could have changed
+    bool checkerboard = false;        // Compute backend only
+    bool reprojectDepth = true;       // Compute backend only, start primary rays from the last frame's depth
+    bool deferredShading = false;     // Compute backend only, G-buffer then separate lighting, shadow and bounce passes
+    bool edgeSupersampling = true;    // Compute backend only
+    int framesInFlight = 2;           // How many frames the CPU can queue ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT
+    bool lateLatchCamera = true;      // Sample the camera again right before submitting
+    int presentMode = 1;              // 0 FIFO, 1 MAILBOX, 2 IMMEDIATE, FIFO when the surface doesn't have the one picked
+    float frameRateLimit = 0.0f;      // Frames per second the CPU limiter holds to, 0 is uncapped
+    bool progressiveTiles = false;    // Compute backend only
+    float tileBudget = 8.0f;          // Milliseconds of GPU time per frame the progressive tiles get
+    bool skipCoveredPixels = true;    // Don't raymarch under opaque ImGui windows
+    bool interactionPreview = true;   // Drop to the preview tier while moving or dragging in the UI
+    float previewRenderScale = 0.5f;  // Compute backend only
+    int previewSteps = 64;            // num_steps is capped to this while previewing, ray_depth is 1 and shadows are off
+};
+
+// Measured by the renderer, shown in the UI
+struct RendererStats {
+    float renderScale = 1.0f;
+    float gpuFrameTime = 0.0f; // Milliseconds, 0 when the GPU can't write timestamps
+    int accumulatedSamples = 0;
+    float frameRate = 0.0f;       // Frames drawn over the last second
+    float cpuFrameTime = 0.0f;    // Milliseconds between the starts of the last two frames
+    float presentInterval = 0.0f; // Milliseconds between the last two frames reaching the display, 0 when the driver doesn't say
+    float refreshInterval = 0.0f; // Milliseconds per display refresh, 0 when the driver doesn't say
+    int progressiveTilesDone = 0;
+    int progressiveTileCount = 0;
+};
+
+// The per frame resources are made for this many, settings.framesInFlight picks how many of them are used
+const int MAX_FRAMES_IN_FLIGHT = 4;
+
 const std::string INIT_SKYBOX = "skyboxes\\Black.png";
 const std::string INIT_TEXTURE = "textures\\Black.png";
 const std::string TEST_TEXTURE = "textures\\JustAGuy.png";
@@ -211,6 +261,9 @@ public:
 
     bool framebufferResized = false;
 
+    RendererSettings settings;
+    RendererStats stats;
+
     void run(GLFWwindow* window);
 
     void initRenderer(GLFWwindow* window);
@@ -239,6 +292,16 @@ public:
 
     GLFWwindow* getWindow();
 
+    bool needsRedraw();
+
+    void requestRedraw();
+
+    void setCameraLatch(void (*latch)());
+
+    void markOpaqueWindow();
+
+    void noteInteraction();
+
 private:
 
     VkInstance instance;
@@ -273,20 +336,168 @@ private:
     std::vector<VkImageView> swapChainImageViews;
     std::vector<VkFramebuffer> swapChainFramebuffers;
 
+    // Frame pacing, the settings.presentMode the swap chain was made for and the limiter and present timing state
+    int swapChainPresentModeSetting = -1;
+    std::chrono::steady_clock::time_point pacingFrameStart;
+    bool pacingFrameStartValid = false;
+    std::chrono::steady_clock::time_point frameRateWindowStart;
+    int frameRateFrames = 0;
+    bool displayTimingSupported = false; // VK_GOOGLE_display_timing
+    PFN_vkGetPastPresentationTimingGOOGLE getPastPresentationTiming = nullptr;
+    PFN_vkGetRefreshCycleDurationGOOGLE getRefreshCycleDuration = nullptr;
+    uint32_t presentID = 0;
+    uint64_t lastActualPresentTime = 0;
+
     VkDescriptorSetLayout descriptorSetLayout;
 
     VkRenderPass renderPass;
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    VkPipeline graphicsPipeline; // Generic shader with the default specialization, always valid
+    VkPipeline computePipeline;  // Same for the compute backend
+    VkPipeline compositePipeline;
+
+    // Pipelines per specialization of the generic and the scene shader, see currentRaymarchPipeline
+    struct RaymarchPipelineVariant {
+        RaymarchSpecialization specialization;
+        bool scene;
+        bool compute;
+        VkPipeline pipeline;
+    };
+    std::vector<RaymarchPipelineVariant> raymarchPipelineVariants;
+    std::vector<char> genericFragShaderCode;
+    std::vector<char> genericComputeShaderCode;
+    int worldChainStackSize = MAX_OBJECTS;
+    int worldImageCount = MAX_IMAGES;
+
+    // Scene specialized shader, see generateSceneShader
+    enum class SceneShaderState { Idle, Compiling, Ready, Failed };
+    std::vector<char> sceneFragShaderCode;
+    std::vector<char> sceneComputeShaderCode;
+    std::string sceneShaderSource;          // Generated from the current world
+    std::string scenePipelineSource;        // What sceneFragShaderCode was built from
+    std::string sceneShaderCompilingSource;
+    std::string sceneShaderFailedSource;    // Not retried until the tree changes again
+    // Built by the worker from sceneShaderCompilingSource, taken over once it's Ready
+    std::vector<char> sceneShaderCompiledCode;
+    std::vector<char> sceneComputeShaderCompiledCode;
+    RaymarchSpecialization sceneShaderCompiledSpecialization;
+    VkPipeline sceneShaderCompiledPipeline = VK_NULL_HANDLE;
+    VkPipeline sceneComputeShaderCompiledPipeline = VK_NULL_HANDLE;
+    std::thread sceneShaderThread;
+    std::atomic<SceneShaderState> sceneShaderState{ SceneShaderState::Idle };
+
+    // Cone prepass, a low resolution pass writing the distance every primary ray can safely start at
+    VkRenderPass conePrepassRenderPass;
+    VkPipeline conePrepassPipeline;
+    VkExtent2D conePrepassExtent;
+    VkImage conePrepassImage;
+    VkDeviceMemory conePrepassImageMemory;
+    VkImageView conePrepassImageView;
+    VkFramebuffer conePrepassFramebuffer;
+
+    // Compute backend output, kept in VK_IMAGE_LAYOUT_GENERAL and copied into the swap chain pass by compositePipeline
+    VkImage raymarchImage;
+    VkDeviceMemory raymarchImageMemory;
+    VkImageView raymarchImageView;
+
+    // Temporal accumulation, the running average of the jittered samples since the camera or the scene last changed
+    VkImage historyImage;
+    VkDeviceMemory historyImageMemory;
+    VkImageView historyImageView;
+    SaveData accumulationSource;
+    VkExtent2D accumulationExtent;
+    bool accumulationValid = false;
+    RaymarchConstants raymarchConstants{};
+
+    // Scene cache, what raymarchImage was last raymarched with so frames that only change ImGui can reuse it
+    SaveData sceneImageSource;
+    VkExtent2D sceneImageExtent;
+    bool sceneImageValid = false;
+
+    // Checkerboard and depth seeding, this frame's and the last frame's color and primary hit distance, swapped every
+    // dispatch, and the SaveData the last frame was marched with
+    std::array<VkImage, 2> reprojectionImages;
+    std::array<VkDeviceMemory, 2> reprojectionImagesMemory;
+    std::array<VkImageView, 2> reprojectionImageViews;
+    SaveData reprojectionSource;
+    VkExtent2D reprojectionExtent;
+    bool reprojectionValid = false;
+    int reprojectionParity = 0;
+
+    // Object the primary ray of every pixel hit this frame (-1 for none), edges between objects of similar depth
+    // and color still get supersampled
+    VkImage objectIdImage;
+    VkDeviceMemory objectIdImageMemory;
+    VkImageView objectIdImageView;
+
+    // Depth seeding, the last frame's primary hit distances splatted into this frame's pixels as float bits
+    VkImage depthSeedImage;
+    VkDeviceMemory depthSeedImageMemory;
+    VkImageView depthSeedImageView;
+
+    // Deferred shading, the G-buffer (normal and distance, indices and steps) and the lit color the passes hand on
+    VkImage gBufferImage;
+    VkDeviceMemory gBufferImageMemory;
+    VkImageView gBufferImageView;
+    VkImage gBufferIdImage;
+    VkDeviceMemory gBufferIdImageMemory;
+    VkImageView gBufferIdImageView;
+    VkImage lightingImage;
+    VkDeviceMemory lightingImageMemory;
+    VkImageView lightingImageView;
+    bool gBufferImagesFull = false; // Swap chain sized, otherwise 1x1 while deferred shading is off
+
+    // Covered pixels, the opaque ImGui windows of this UI frame (min xy, max xy in swap chain pixels), what's left of
+    // the swap chain and the part of renderExtent that's raymarched
+    std::vector<glm::vec4> uiOpaqueRects;
+    VkRect2D uiVisibleRect{};
+    VkRect2D raymarchRect{};
+
+    // Interaction preview, when the camera moved or a UI item was dragged last and whether this frame is a preview one
+    const float PREVIEW_HOLD = 0.1f; // Seconds without interaction before refining, input doesn't come every frame
+    std::chrono::steady_clock::time_point lastInteraction;
+    bool interactionNoted = false;
+    bool previewActive = false;
+
+    // Progressive tiles, the round being marched into raymarchImage a few tiles per frame
+    const uint32_t PROGRESSIVE_TILE_SIZE = 64; // Pixels, a multiple of the 8x8 groups
+    SaveData progressiveSource;
+    VkExtent2D progressiveExtent;
+    int progressiveSampleIndex = 0;
+    uint32_t progressiveTileCount = 0;
+    uint32_t progressiveCursor = 0;         // Next tile, in rows from the top left
+    uint32_t progressiveFrameFirstTile = 0; // Where this frame's tiles started
+    bool progressiveValid = false;
+    float progressiveTileRate = 4.0f;       // Tiles per frame, from the GPU time of the last ones
+    std::vector<uint32_t> frameTiles;       // Tiles each frame in flight marched
+
+    // Late latch, main.cpp's function that takes in the input that arrived while the frame was being built
+    void (*cameraLatch)() = nullptr;
+    bool frameRaymarched = false;
+
+    // Render on demand, what the last frame drew and how many more frames to draw regardless (ImGui needs a few to settle after input)
+    SaveData drawnSaveData;
+    bool drawnSaveDataValid = false;
+    int redrawFrames = 0;
+
+    // Dynamic resolution, the raymarch only covers renderExtent of the swap chain sized images
+    VkExtent2D renderExtent;
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE; // Two per frame in flight, start and end of the command buffer
+    float timestampPeriod = 0.0f;
+    std::vector<bool> frameTimed;                     // Recorded timestamps and raymarched, frames that only drew ImGui don't count
+    std::vector<float> frameRenderScale;             // Scale each frame in flight was recorded with
 
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
 
-    const int MAX_FRAMES_IN_FLIGHT = 2;
+    // Every submit signals the next value, a frame's resources are free again once its value has been reached
+    VkSemaphore frameTimeline;
+    uint64_t frameTimelineValue = 0;
+    std::vector<uint64_t> frameTimelineValues; // Value each frame in flight was submitted with
+
     uint32_t currentFrame = 0;
 
     const std::vector<const char*> deviceExtensions = {
@@ -362,28 +573,30 @@ private:
     VkDescriptorPool descriptorPool;
     std::vector<VkDescriptorSet> descriptorSets;
 
-    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkImage colorImage;
-    VkDeviceMemory colorImageMemory;
-    VkImageView colorImageView;
-
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
-
     uint32_t mipLevels;
     VkImage textureImage[MAX_IMAGES];
     VkDeviceMemory textureImageMemory[MAX_IMAGES];
     VkImageView imageView[MAX_IMAGES];
+    VkImage bumpImage[MAX_IMAGES];
+    VkDeviceMemory bumpImageMemory[MAX_IMAGES];
+    VkImageView bumpImageView[MAX_IMAGES];
     VkSampler textureSampler;
 
     std::vector<VkBuffer> cameraUniformBuffers;
     std::vector<VkDeviceMemory> cameraUniformBuffersMemory;
+    std::vector<void*> cameraUniformBuffersMapped; // Stays mapped so the late latch is a single memcpy
 
     std::vector<VkBuffer> worldObjectsUniformBuffers;
     std::vector<VkDeviceMemory> worldObjectsUniformBuffersMemory;
 
+    std::vector<VkBuffer> worldBVHUniformBuffers;
+    std::vector<VkDeviceMemory> worldBVHUniformBuffersMemory;
+
+    WorldBVHData worldBVHData{};
+    WorldObjectsData worldBVHSource{}; // World the BVH was last built from
+    float worldBVHBumpHeight = 0.0f;
+    bool worldBVHValid = false;
+
 
     SaveData* saveData;
 
@@ -435,6 +648,7 @@ private:
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool deviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName);
 
 
     // Create Logical Device
@@ -470,13 +684,101 @@ private:
     // Create The Graphics Pipeline - I might be able to remove most of this since i am only working/mainly in the fragment shader
     void createGraphicsPipeline();
 
+    VkPipeline createRaymarchPipeline(const std::vector<char>& fragShaderCode, const RaymarchSpecialization* specialization, VkRenderPass targetRenderPass);
+
+    RaymarchSpecialization currentRaymarchSpecialization();
+
+    VkPipeline createRaymarchComputePipeline(const std::vector<char>& computeShaderCode, const RaymarchSpecialization* specialization);
+
+    VkPipeline getRaymarchPipeline(bool scene, bool compute, const RaymarchSpecialization& specialization);
+
+    void destroyRaymarchPipelineVariants(bool scene);
+
+    void updateWorldSpecialization();
+
     VkShaderModule createShaderModule(const std::vector<char>& code);
 
 
+    // Scene Specialized Shader
+    std::string generateSceneShader();
+
+    void updateSceneShader();
+
+    VkPipeline currentRaymarchPipeline(bool compute);
+
+
     // Create Render Pass
     void createRenderPass();
 
 
+    // Cone Prepass
+    void createConePrepassRenderPass();
+
+    void createConePrepassResources();
+
+    void cleanupConePrepassResources();
+
+    void recordConePrepass(VkCommandBuffer commandBuffer);
+
+
+    // Compute Backend
+    void createRaymarchImage();
+
+    void cleanupRaymarchImage();
+
+    void recordRaymarchDispatch(VkCommandBuffer commandBuffer);
+
+
+    // Progressive Tiles
+    void recordProgressiveTiles(VkCommandBuffer commandBuffer, const VkMemoryBarrier& storageBarrier);
+
+    bool progressiveTilesPending();
+
+
+    // Depth Seeding
+    void recordDepthSeed(VkCommandBuffer commandBuffer, const VkMemoryBarrier& storageBarrier);
+
+    bool reprojectionGeometryCurrent();
+
+
+    // Deferred Shading
+    void createGBufferImages();
+
+    void cleanupGBufferImages();
+
+    void updateGBufferImages();
+
+
+    // Covered Pixels
+    void updateRaymarchRect();
+
+
+    // Interaction Preview
+    void updateInteractionPreview();
+
+
+    // Dynamic Resolution
+    void createTimestampQueries();
+
+    void updateRenderScale();
+
+
+    // Temporal Accumulation
+    void updateAccumulation();
+
+    bool accumulationConverged();
+
+    bool worldUsesTime();
+
+    bool saveDataChanged(const SaveData& source);
+
+
+    // Scene Cache
+    bool sceneImageCurrent();
+
+    bool raymarchNeeded();
+
+
     // Create Frame Buffers
     void createFramebuffers();
 
@@ -510,21 +812,13 @@ private:
 
     void createTextureImageView(size_t index);
 
+    void createBumpDerivativeImage(const stbi_uc* pixels, int texWidth, int texHeight, size_t index);
+
     void createTextureSampler();
 
     void cleanupTexture(size_t index);
 
 
-    // Create Depth Buffer
-    void createDepthResources();
-
-    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
-
-    VkFormat findDepthFormat();
-
-    bool hasStencilComponent(VkFormat format);
-
-
     // Create Model
     //void loadModel();
 
@@ -533,12 +827,6 @@ private:
     void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 
 
-    // Setup Multisampling
-    VkSampleCountFlagBits getMaxUsableSampleCount();
-
-    void createColorResources();
-
-
     // Create Vertex Buffer - Not Really Needed for a Path Tracer
     void createVertexBuffer();
 
@@ -557,6 +845,21 @@ private:
     void createUniformBuffers();
 
     void updateUniformBuffer(uint32_t currentImage);
+    void updateCameraBuffer(uint32_t currentImage);
+    void latchCamera();
+    void updateWorldBVH();
+    void buildUiFrame();
+    void paceFrame();
+    void updatePresentTiming();
+    void waitForFrame();
+
+    void buildWorldBVH();
+
+    int buildWorldBVHNode(std::vector<int>& leaves, size_t begin, size_t end, const glm::vec3* leafMin, const glm::vec3* leafMax);
+
+    bool boundWorldIndexTree(int type, int index, glm::vec3& boundsMin, glm::vec3& boundsMax, int depth);
+
+    bool boundWorldObject(int index, glm::vec3& boundsMin, glm::vec3& boundsMax);
 
     void createDescriptorPool();
 
@@ -1,3 +1,6 @@
 C:\VulkanSDK\1.3.290.0\Bin\glslc.exe shader.vert -o vert.spv || (echo "Vertex shader compilation failed. Press any key to exit..." && pause && exit /b)
 C:\VulkanSDK\1.3.290.0\Bin\glslc.exe shader.frag -o frag.spv || (echo "Fragment shader compilation failed. Press any key to exit..." && pause && exit /b)
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe -DCONE_PREPASS shader.frag -o cone_frag.spv || (echo "Cone prepass shader compilation failed. Press any key to exit..." && pause && exit /b)
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe -fshader-stage=comp -DCOMPUTE_BACKEND shader.frag -o comp.spv || (echo "Compute shader compilation failed. Press any key to exit..." && pause && exit /b)
+C:\VulkanSDK\1.3.290.0\Bin\glslc.exe composite.frag -o composite_frag.spv || (echo "Composite shader compilation failed. Press any key to exit..." && pause && exit /b)
 echo "Shaders Compiled"
\ No newline at end of file
@@ -0,0 +1,54 @@
+#version 450
+
+// Copies the compute backend's raymarch image into the swap chain pass, ImGui is drawn over it afterwards.
+// With dynamic resolution only the top left renderSize pixels of the image were raymarched and get scaled up.
+layout(binding = 7) uniform sampler2D raymarchSampler;
+
+layout(push_constant) uniform CompositeConstants {
+    vec2 renderSize;    // Raymarched pixels
+    vec2 targetSize;    // Swap chain pixels
+    int edgeAware;
+} composite;
+
+layout(location = 0) out vec4 outColor;
+
+// Bilinear, but every tap is weighted down by how different it is from the closest texel so edges stay sharp
+vec3 edge_aware_sample(vec2 p) {
+    vec2 base = floor(p - 0.5);
+    vec2 f = p - 0.5 - base;
+    ivec2 maxTexel = ivec2(composite.renderSize) - 1;
+
+    vec3 taps[4];
+    taps[0] = texelFetch(raymarchSampler, clamp(ivec2(base), ivec2(0), maxTexel), 0).rgb;
+    taps[1] = texelFetch(raymarchSampler, clamp(ivec2(base) + ivec2(1, 0), ivec2(0), maxTexel), 0).rgb;
+    taps[2] = texelFetch(raymarchSampler, clamp(ivec2(base) + ivec2(0, 1), ivec2(0), maxTexel), 0).rgb;
+    taps[3] = texelFetch(raymarchSampler, clamp(ivec2(base) + ivec2(1, 1), ivec2(0), maxTexel), 0).rgb;
+    float weights[4] = float[4]((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+
+    vec3 nearest = taps[(f.x < 0.5 ? 0 : 1) + (f.y < 0.5 ? 0 : 2)];
+    vec3 color = vec3(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec3 diff = taps[i] - nearest;
+        float w = weights[i] * exp(-dot(diff, diff) * 16.0);
+        color += taps[i] * w;
+        total += w;
+    }
+    return color / total;
+}
+
+void main() {
+    if (composite.renderSize == composite.targetSize) {
+        outColor = vec4(texelFetch(raymarchSampler, ivec2(gl_FragCoord.xy), 0).rgb, 1.0);
+        return;
+    }
+
+    // Position in raymarched pixels, kept half a texel inside so the bilinear taps never read past what was rendered
+    vec2 p = clamp(gl_FragCoord.xy * composite.renderSize / composite.targetSize, vec2(0.5), composite.renderSize - 0.5);
+    if (composite.edgeAware != 0) {
+        outColor = vec4(edge_aware_sample(p), 1.0);
+    }
+    else {
+        outColor = vec4(textureLod(raymarchSampler, p / vec2(textureSize(raymarchSampler, 0)), 0.0).rgb, 1.0);
+    }
+}
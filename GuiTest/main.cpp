@@ -1,6 +1,12 @@
 #include "main.h"
 #include "json.hpp"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
 const uint32_t WIDTH = 1200;
 const uint32_t HEIGHT = 800;
 const char* title = "Vulkan";
@@ -27,6 +33,8 @@ float deltaTime = 0.0f;
 
 float speedUp = 1.0f;
 
+bool waitedForEvents = false;
+
 // Create the window outside the application class so i can set up input
 void initWindow() {
     glfwInit();
@@ -39,6 +47,11 @@ void initWindow() {
 void configureInput() {
     glfwSetKeyCallback(windowMain, key_callback);
     glfwSetCursorPosCallback(windowMain, cursor_position_callback);
+    // Only there to wake up render on demand, ImGui chains onto these
+    glfwSetMouseButtonCallback(windowMain, mouse_button_callback);
+    glfwSetScrollCallback(windowMain, scroll_callback);
+    glfwSetCharCallback(windowMain, char_callback);
+    glfwSetWindowRefreshCallback(windowMain, window_refresh_callback);
 }
 
 void enableInput() {
@@ -86,6 +99,12 @@ void updateCamData() {
     deltaTimeModified = deltaTime * saveData.camData.data4.w;
     prevTime = currentTime;
 
+    // Don't move the camera by the time spent waiting for the key press
+    if (waitedForEvents) {
+        deltaTime = 0.0f;
+        waitedForEvents = false;
+    }
+
     int width = 0, height = 0;
     glfwGetFramebufferSize(windowMain, &width, &height);
     saveData.camData.resolution = glm::vec2(width, height);
@@ -102,6 +121,7 @@ void updateCamData() {
 
 // Set Up Keyboard Input
 void moveForwards(float speed) {
+    app.noteInteraction();
     speed *= deltaTime * speedUp;
     float x = std::sin(saveData.camData.camera_rot.x) * speed;
     float z = std::cos(saveData.camData.camera_rot.x) * speed;
@@ -110,6 +130,7 @@ void moveForwards(float speed) {
 }
 
 void moveLeft(float speed) {
+    app.noteInteraction();
     speed *= deltaTime * speedUp;
     float x = std::sin(saveData.camData.camera_rot.x + glm::radians(90.0f)) * speed;
     float z = std::cos(saveData.camData.camera_rot.x + glm::radians(90.0f)) * speed;
@@ -118,11 +139,13 @@ void moveLeft(float speed) {
 }
 
 void moveUp(float speed) {
+	app.noteInteraction();
 	speed *= deltaTime * speedUp;
 	saveData.camData.camera_pos.y += speed;
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    app.requestRedraw();
 
     if (app.uiWantsKeyboard()) {
         // ImGui is handling the keyboard, do not handle camera input
@@ -162,6 +185,7 @@ void createControls() {
 }
 
 void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
+    app.requestRedraw();
     if (app.uiWantsMouse()) {
         // ImGui is handling the mouse, do not handle camera input
         return;
@@ -180,6 +204,10 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
         xoffset *= sensitivity;
         yoffset *= sensitivity;
 
+        if (xoffset != 0.0f || yoffset != 0.0f) {
+            app.noteInteraction();
+        }
+
         saveData.camData.camera_rot.x += xoffset;
         saveData.camData.camera_rot.y += yoffset;
 
@@ -192,18 +220,37 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
     //glfwSetCursorPos(window, app.getWindowWidth()/2, app.getWindowHeight()/2);
 }
 
-int calcFPS() {
-    static int frameCount = 0;
-    static double prevTime = glfwGetTime();
-    double currentTime = glfwGetTime();
-    frameCount++;
-    if (currentTime - prevTime >= 1.0) {
-        int fps = frameCount;
-        frameCount = 0;
-        prevTime = currentTime;
-        return fps;
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    app.requestRedraw();
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+    app.requestRedraw();
+}
+
+void char_callback(GLFWwindow* window, unsigned int codepoint) {
+    app.requestRedraw();
+}
+
+void window_refresh_callback(GLFWwindow* window) {
+    app.requestRedraw();
+}
+
+// The renderer calls this right before it submits a frame. The mouse moves at the front of the queue, the ones that
+// came in while the frame was being built, are dispatched to GLFW's window procedure so cursor_position_callback runs
+// for them and mouse look lags by the GPU time instead of the whole frame. It stops at the first other message, a
+// click or key stays ahead of the moves after it and everything is left for the next glfwPollEvents in order. A full
+// poll here would run the key and ImGui callbacks and could resize the window mid frame. Keys only move the camera in
+// updateCamData, by deltaTime, anyway. Elsewhere there's no way to take just the moves, the camera keeps the pose the
+// frame started with.
+void latchInput() {
+#ifdef _WIN32
+    MSG msg;
+    while (PeekMessageW(&msg, nullptr, 0, 0, PM_NOREMOVE) && msg.message == WM_MOUSEMOVE) {
+        PeekMessageW(&msg, nullptr, WM_MOUSEMOVE, WM_MOUSEMOVE, PM_REMOVE);
+        DispatchMessageW(&msg);
     }
-    return 0;
+#endif
 }
 
 void playAnimations() {
@@ -289,6 +336,20 @@ void playAnimations() {
     }
 }
 
+// Seconds until the soonest animation changes a value, how long the main loop can sleep for
+double timeUntilNextAnimationStep() {
+    double timeMultiplier = std::abs(saveData.camData.data4.w);
+    double soonest = std::numeric_limits<double>::infinity();
+    if (timeMultiplier == 0.0) return soonest;
+
+    for (auto& [key, animation] : animations) {
+        if (animation.typeVal == 0 && animation.stepI == 0) continue;
+        if (animation.typeVal == 1 && animation.stepF == 0) continue;
+        soonest = std::min(soonest, std::max(0.0, (double)(animation.timePerStep - animation.timeSinceLastStep)) / timeMultiplier);
+    }
+    return soonest;
+}
+
 int main() {
     initWindow();
     initCamData();
@@ -303,13 +364,20 @@ int main() {
         app.initGui(&inputEnabled, &enableInput, &animations);
         app.initRenderer(windowMain);
         app.updateOldSaves();
+        app.setCameraLatch(&latchInput);
 
         while (!glfwWindowShouldClose(windowMain)) {
-            glfwPollEvents();
-            playAnimations();
+            // Nothing to draw and no keys held, sleep until there's input or an animation is due
+            if (controlsPressed.empty() && !app.needsRedraw()) {
+                glfwWaitEventsTimeout(std::min(timeUntilNextAnimationStep(), 0.5));
+                waitedForEvents = true;
+            }
+            else {
+                glfwPollEvents();
+            }
             updateCamData();
-            int fps = calcFPS();
-            if(fps != 0) std::cout << fps << std::endl;
+            playAnimations();
+            if (!app.needsRedraw()) continue;
             app.drawFrame();
         }
 
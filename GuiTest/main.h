@@ -57,5 +57,17 @@ void createControls();
 
 void cursor_position_callback(GLFWwindow* window, double xpos, double ypos);
 
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+
+void char_callback(GLFWwindow* window, unsigned int codepoint);
+
+void window_refresh_callback(GLFWwindow* window);
+
+void latchInput();
+
+double timeUntilNextAnimationStep();
+
 int main();
 
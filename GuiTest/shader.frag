@@ -935,10 +935,25 @@ float fOpTongue(float a, float b, float ra, float rb) {
 // Rendering code
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-const int OBJECT_COUNT_MAX = 32;
-const int IMAGE_COUNT_MAX = 16;
+const int OBJECT_COUNT_MAX = 32; // Sizes the uniform blocks, has to match MAX_OBJECTS
+
+// Specialization constants, set per world by VulkanRenderer::currentRaymarchSpecialization. The defaults are the largest values.
+layout(constant_id = 0) const int CHAIN_STACK_SIZE = 32;	// Combine modifiers one index chain can buffer
+layout(constant_id = 1) const int IMAGE_COUNT_MAX = 16;		// Highest texture slot the world uses + 1
+layout(constant_id = 2) const int MAX_ITER_COUNT = 5;		// camData.ray_depth
+// Only bounds a broken camData.num_steps. Not specialized, the march loops run on num_steps anyway and every Number of
+// Steps value would otherwise be its own pipeline.
+const int MAX_STEP_COUNT = 65536;
 
 layout(binding = 4) uniform sampler2D texSampler[IMAGE_COUNT_MAX];
+layout(binding = 5) uniform sampler2D bumpSampler[IMAGE_COUNT_MAX]; // Height derivatives (texels) of each texture, used by the normal bump mode
+
+// Low resolution start distances from the cone prepass (cone_frag.spv, built with CONE_PREPASS), one texel per tile of
+// CONE_TILE_SIZE^2 pixels. Has to match CONE_PREPASS_TILE_SIZE.
+const int CONE_TILE_SIZE = 8;
+#ifndef CONE_PREPASS
+layout(binding = 3) uniform sampler2D coneDepthSampler;
+#endif
 
 struct WorldObject {
     vec3 center;
@@ -1028,17 +1043,14 @@ struct PixelInfo{
 	vec3 normal;
 };
 
-struct HitInfo{
-	vec3 rd;
+// A pending ray of the reflection/refraction tree, weight is the share of the pixel its color gets
+struct RayTask{
 	vec3 ro;
-	vec3 color;
+	vec3 rd;
+	float weight;
 	float totalDist;
 	int index;
-	int steps;
-	float influence;
-	float totalInfluence;
 	int iterDepth;
-	int parent;
 };
 
 layout(binding = 0) uniform CameraData {
@@ -1076,7 +1088,61 @@ layout(binding = 1) uniform WorldObjectsData {
 	WorldObjectIndex indices[OBJECT_COUNT_MAX];
 } worldObjectsData;
 
+const int BVH_STACK_SIZE = 16; // Has to match WORLD_BVH_STACK_SIZE, which the C++ side asserts is deep enough
+
+struct WorldBVHNode {
+	vec4 boundsMin;
+	vec4 boundsMax;
+	int left;
+	int right;
+	int index;		// World index for leaves, -1 for inner nodes
+	int padding;
+};
+
+// Built on the CPU from the conservative bounds of every index tree, see VulkanRenderer::buildWorldBVH
+layout(binding = 2) uniform WorldBVHData {
+	int num_nodes;
+	int num_unbounded;
+	ivec4 unbounded[OBJECT_COUNT_MAX/4];	// Indices without bounds (planes, repeats, moving modifiers), always evaluated
+	WorldBVHNode nodes[OBJECT_COUNT_MAX*2];
+} worldBVH;
+
+#ifdef COMPUTE_BACKEND
+// Compute backend (comp.spv, built with COMPUTE_BACKEND as a compute shader), one 8x8 group per cone prepass tile
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+layout(binding = 6, rgba16f) uniform writeonly image2D raymarchImage;
+layout(binding = 8, rgba32f) uniform image2D historyImage;     // rgb: mean of the samples so far, a: how many
+// Color and primary hit distance of this frame and the last, which is which flips with raymarch.frameParity
+layout(binding = 9, rgba32f) uniform image2D reprojectionImageA;
+layout(binding = 10, rgba32f) uniform image2D reprojectionImageB;
+// Object the primary ray hit this frame, -1 for the sky or running out of steps, so on_edge sees where objects meet
+layout(binding = 11, r32i) uniform iimage2D objectIdImage;
+
+// The last frame's primary hit distances moved into this frame's pixels, float bits so the nearest wins the atomicMin
+layout(binding = 12, r32ui) uniform uimage2D depthSeedImage;
+// Deferred shading's G-buffer, written by the primary pass and read by the passes after it
+layout(binding = 13, rgba32f) uniform image2D gBufferImage;      // xyz: normal (the bumped one after lighting), w: primary hit distance
+layout(binding = 14, rgba32i) uniform iimage2D gBufferIdImage;   // x: world index, y: object (-1 sky, -2 out of steps), z: steps, w: bounce weights as halfs
+layout(binding = 15, rgba16f) uniform image2D lightingImage;     // rgb: the hit's own share of the color, a: diffuse intensity
+
+layout(push_constant) uniform RaymarchConstants {
+    vec4 prevCameraPos;     // w: previous FOV
+    vec4 prevCameraRot;
+    vec2 jitter;            // Sub pixel offset of this sample
+    int sampleIndex;        // 0 restarts the history
+    int pass;               // 0 every pixel, 1 shades half of them, 2 reconstructs the other half, 3 supersamples the edges, 4 splats the last frame's depth, 5-8 deferred
+    int frameParity;
+    ivec2 tileOffset;       // First pixel of the dispatch, a progressive tile run or the uncovered part
+    int shadowsOff;         // 1 for the renderer's interaction preview tier
+    int seedDepth;          // 1 when depthSeedImage has this frame's splats
+} raymarch;
+#else
 layout(location = 0) out vec4 outColor;
+// The fragment backend's only constant, it shares the fragment range with the composite's
+layout(push_constant) uniform FragmentConstants {
+    int shadowsOff;
+} raymarch;
+#endif
 
 float d_wiggle_sphere(in vec3 p, float radius, float multi){
     float displacement = sin(2.0 * p.x + multi) * sin(3.0 * p.y + multi * -3.0) * sin(7.0 * p.z - multi * 0.5) * 0.25;
@@ -1110,10 +1176,11 @@ std::vector<std::string> worldObjectTypes = {
 };
 */
 
-float map_the_object(in vec3 p, in int objectIndex){
+// The type is passed in so the scene specialized shader can give it as a constant and drop the switch
+float map_the_object_type(in vec3 p, in int objectIndex, in int type){
 
 	vec3 point = p - worldObjectsData.objects[objectIndex].center;
-	switch(worldObjectsData.objects[objectIndex].type){
+	switch(type){
 	case 0:
 		return 1000000000.0;
 	case 1:
@@ -1152,27 +1219,134 @@ float map_the_object(in vec3 p, in int objectIndex){
     return 1000000000.0;
 }
 
+float map_the_object(in vec3 p, in int objectIndex){
+	return map_the_object_type(p, objectIndex, worldObjectsData.objects[objectIndex].type);
+}
+
 vec3 reflect_ray(in vec3 incident, in vec3 normal){
     return incident - 2.0 * dot(incident, normal) * normal;
 }
 
-vec3 calculate_normal_object(in vec3 p, int objectIndex, float totalDist){
-    // const vec3 small_step = vec3(max(camData.data4.z, camData.data4.z*totalDist), 0.0, 0.0);
-	vec3 small_step;
-	if(camData.data4.z <= 0.0){
-		 small_step= vec3(0.001, 0.0, 0.0);
+vec3 sgn3(vec3 v){
+	return vec3(sgn(v.x), sgn(v.y), sgn(v.z));
+}
+
+// Gradient of vmax, picks the largest component
+vec2 vmaxGrad(vec2 v){
+	return v.x >= v.y ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
+}
+
+vec3 vmaxGrad(vec3 v){
+	if(v.x >= v.y && v.x >= v.z) return vec3(1.0, 0.0, 0.0);
+	return v.y >= v.z ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+}
+
+// Unit direction away from the y axis, used by the round primitives
+vec3 radialDir(vec3 p){
+	return vec3(p.x, 0.0, p.z) / max(length(p.xz), 1e-8);
+}
+
+// Analytic gradient of map_the_object, exact is cleared for the primitives that need a numeric estimate (blob and wiggles)
+vec3 map_the_object_grad(in vec3 p, in int objectIndex, out bool exact){
+	vec3 point = p - worldObjectsData.objects[objectIndex].center;
+	vec3 size = worldObjectsData.objects[objectIndex].size;
+	exact = true;
+	switch(worldObjectsData.objects[objectIndex].type){
+	case 1: // fPlane
+		return size;
+	case 2: // fSphere
+		return point / max(length(point), 1e-8);
+	case 3: { // fBox
+		vec3 d = abs(point) - size;
+		vec3 outside = max(d, vec3(0));
+		float l = length(outside);
+		return sgn3(point) * (l > 0.0 ? outside / l : vmaxGrad(d));
+	}
+	case 4: { // fBox2
+		vec2 d = abs(point.xz) - size.xz;
+		vec2 outside = max(d, vec2(0));
+		float l = length(outside);
+		vec2 g = sgn(point.xz) * (l > 0.0 ? outside / l : vmaxGrad(d));
+		return vec3(g.x, 0.0, g.y);
+	}
+	case 5: { // fCorner
+		vec2 outside = max(point.xy, vec2(0));
+		float l = length(outside);
+		return vec3(l > 0.0 ? outside / l : vmaxGrad(point.xy), 0.0);
+	}
+	case 7: // fCylinder
+		if(length(point.xz) - size.x > abs(point.y) - size.y) return radialDir(point);
+		return vec3(0.0, sgn(point.y), 0.0);
+	case 8: // fCapsule
+		if(abs(point.y) < size.y) return radialDir(point);
+		return normalize(vec3(point.x, (abs(point.y) - size.y) * sgn(point.y), point.z));
+	case 9: { // fTorus
+		vec2 q = vec2(length(point.xz) - size.y, point.y);
+		q /= max(length(q), 1e-8);
+		return radialDir(point) * q.x + vec3(0.0, q.y, 0.0);
+	}
+	case 10: // fCircle
+	case 11: { // fDisc
+		float l = length(point.xz) - size.x;
+		if(worldObjectsData.objects[objectIndex].type == 11 && l < 0.0) return vec3(0.0, sgn(point.y), 0.0);
+		return (radialDir(point) * l + vec3(0.0, point.y, 0.0)) / max(length(vec2(point.y, l)), 1e-8);
+	}
+	case 12: // fHexagonCircumcircle
+	case 13: { // fHexagonIncircle
+		vec2 h = size.xy;
+		if(worldObjectsData.objects[objectIndex].type == 13) h.x *= sqrt(3)*0.5;
+		vec3 q = abs(point);
+		vec3 s = sgn3(point);
+		float side = q.x*sqrt(3)*0.5 + q.z*0.5;
+		if(q.y - h.y > max(side, q.z) - h.x) return vec3(0.0, s.y, 0.0);
+		if(side > q.z) return vec3(s.x*sqrt(3)*0.5, 0.0, s.z*0.5);
+		return vec3(0.0, 0.0, s.z);
+	}
+	case 14: { // fCone, same branches as the distance
+		float radius = size.x;
+		float height = size.y;
+		vec2 q = vec2(length(point.xz), point.y);
+		vec2 tip = q - vec2(0, height);
+		vec2 mantleDir = normalize(vec2(height, radius));
+		float mantle = dot(tip, mantleDir);
+		float d = max(mantle, -q.y);
+		vec2 g = mantle > -q.y ? mantleDir : vec2(0.0, -1.0);
+		float projected = dot(tip, vec2(mantleDir.y, -mantleDir.x));
+		if ((q.y > height) && (projected < 0) && length(tip) > d) {
+			d = length(tip);
+			g = tip / max(d, 1e-8);
+		}
+		if ((q.x > radius) && (projected > length(vec2(height, radius))) && length(q - vec2(radius, 0)) > d) {
+			g = normalize(q - vec2(radius, 0));
+		}
+		return radialDir(point) * g.x + vec3(0.0, g.y, 0.0);
 	}
-	else{
-		small_step = vec3(max(camData.data4.z, camData.data4.z*totalDist), 0.0, 0.0);
 	}
+	exact = false;
+	return vec3(0.0);
+}
 
-    float gradient_x = map_the_object(p + small_step.xyy, objectIndex) - map_the_object(p - small_step.xyy, objectIndex);
-    float gradient_y = map_the_object(p + small_step.yxy, objectIndex) - map_the_object(p - small_step.yxy, objectIndex);
-    float gradient_z = map_the_object(p + small_step.yyx, objectIndex) - map_the_object(p - small_step.yyx, objectIndex);
+// Finite difference step for the numeric normals
+float normal_step(float totalDist){
+	// return max(camData.data4.z, camData.data4.z*totalDist);
+	if(camData.data4.z <= 0.0){
+		return 0.001;
+	}
+	return max(camData.data4.z, camData.data4.z*totalDist);
+}
 
-    vec3 normal = vec3(gradient_x, gradient_y, gradient_z);
+vec3 calculate_normal_object(in vec3 p, int objectIndex, float totalDist){
+	bool exact;
+	vec3 gradient = map_the_object_grad(p, objectIndex, exact);
+	if(exact) return normalize(gradient);
 
-    return normalize(normal);
+	// Four tap tetrahedral estimate for the primitives without a closed form gradient
+	float h = normal_step(totalDist);
+	const vec2 k = vec2(1.0, -1.0);
+	return normalize(k.xyy * map_the_object(p + k.xyy * h, objectIndex) +
+					 k.yyx * map_the_object(p + k.yyx * h, objectIndex) +
+					 k.yxy * map_the_object(p + k.yxy * h, objectIndex) +
+					 k.xxx * map_the_object(p + k.xxx * h, objectIndex));
 }
 
 /*std::vector<std::string> worldObjectCombineModifierTypes = {
@@ -1320,6 +1494,94 @@ PixelInfo map_the_combine_modifier(int type, float dist1, float dist2, int index
 	return result;
 }
 
+vec2 unionPartials(float a, float b){
+	return a < b ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
+}
+
+vec2 intersectionPartials(float a, float b){
+	return a > b ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
+}
+
+vec2 fOpUnionStairsPartials(float a, float b, float r, float n){
+	float s = r/n;
+	float u = b-r;
+	float m = mod(u - a + s, 2 * s) - s;
+	if (0.5 * (u + a + abs(m)) < min(a, b)) return vec2(0.5 - 0.5*sgn(m), 0.5 + 0.5*sgn(m));
+	return unionPartials(a, b);
+}
+
+vec2 fOpIntersectionRoundPartials(float a, float b, float r){
+	vec2 u = max(vec2(r + a,r + b), vec2(0));
+	float l = length(u);
+	return (max(a, b) < -r ? intersectionPartials(a, b) : vec2(0.0)) + (l > 0.0 ? u / l : vec2(0.0));
+}
+
+vec2 fOpIntersectionChamferPartials(float a, float b, float r){
+	if ((a + r + b)*sqrt(0.5) > max(a, b)) return vec2(sqrt(0.5));
+	return intersectionPartials(a, b);
+}
+
+// Partial derivatives of map_the_combine_modifier's distance with respect to dist1 and dist2,
+// the chain rule then combines them with the gradients of both sides
+vec2 map_the_combine_modifier_partials(int type, float dist1, float dist2, vec4 data){
+	switch(type){
+		case 1:
+			return unionPartials(dist1, dist2);
+		case 2:
+			return intersectionPartials(dist1, dist2);
+		case 3:
+			return dist1 > -dist2 ? vec2(1.0, 0.0) : vec2(0.0, -1.0);
+		case 4:
+			if ((dist1 - data[0] + dist2)*sqrt(0.5) < min(dist1, dist2)) return vec2(sqrt(0.5));
+			return unionPartials(dist1, dist2);
+		case 5:
+			return fOpIntersectionChamferPartials(dist1, dist2, data[0]);
+		case 6:
+			return fOpIntersectionChamferPartials(dist1, -dist2, data[0]) * vec2(1.0, -1.0);
+		case 7: {
+			vec2 u = max(vec2(data[0] - dist1, data[0] - dist2), vec2(0));
+			float l = length(u);
+			return (min(dist1, dist2) > data[0] ? unionPartials(dist1, dist2) : vec2(0.0)) + (l > 0.0 ? u / l : vec2(0.0));
+		}
+		case 8:
+			return fOpIntersectionRoundPartials(dist1, dist2, data[0]);
+		case 9:
+			return fOpIntersectionRoundPartials(dist1, -dist2, data[0]) * vec2(1.0, -1.0);
+		case 10:
+		case 11:
+		case 12: {
+			// The column pattern is piecewise, differentiate the two scalar inputs numerically instead of the whole SDF
+			const float h = 0.0001;
+			return vec2(map_the_combine_modifier(type, dist1 + h, dist2, 0, 0, vec3(0.0), vec3(0.0), data).dist - map_the_combine_modifier(type, dist1 - h, dist2, 0, 0, vec3(0.0), vec3(0.0), data).dist,
+						map_the_combine_modifier(type, dist1, dist2 + h, 0, 0, vec3(0.0), vec3(0.0), data).dist - map_the_combine_modifier(type, dist1, dist2 - h, 0, 0, vec3(0.0), vec3(0.0), data).dist) / (2.0 * h);
+		}
+		case 13:
+			return fOpUnionStairsPartials(dist1, dist2, data[0], data[1]);
+		case 14:
+			return fOpUnionStairsPartials(-dist1, -dist2, data[0], data[1]);
+		case 15:
+			return fOpUnionStairsPartials(-dist1, dist2, data[0], data[1]) * vec2(1.0, -1.0);
+		case 16: {
+			float e = max(data[0] - abs(dist1 - dist2), 0);
+			return unionPartials(dist1, dist2) + vec2(1.0, -1.0) * sgn(dist1 - dist2) * e * 0.5 / data[0];
+		}
+		case 17:
+			return vec2(dist1, dist2) / max(length(vec2(dist1, dist2)), 1e-8);
+		case 18:
+			if ((dist1 + data[0] - abs(dist2))*sqrt(0.5) > dist1) return vec2(1.0, -sgn(dist2)) * sqrt(0.5);
+			return vec2(1.0, 0.0);
+		case 19:
+			if (min(dist1 + data[0], data[1] - abs(dist2)) > dist1) return dist1 + data[0] < data[1] - abs(dist2) ? vec2(1.0, 0.0) : vec2(0.0, -sgn(dist2));
+			return vec2(1.0, 0.0);
+		case 20:
+			if (max(dist1 - data[0], abs(dist2) - data[1]) < dist1) return dist1 - data[0] > abs(dist2) - data[1] ? vec2(1.0, 0.0) : vec2(0.0, sgn(dist2));
+			return vec2(1.0, 0.0);
+		case 22:
+			return -dist1 > dist2 ? vec2(-1.0, 0.0) : vec2(0.0, 1.0);
+	}
+	return vec2(1.0, 0.0);
+}
+
 void pTwist(inout vec3 p, int axis1, int axis2, int axis3, int axis4, float amount){
 	float c = cos(amount*p[axis1]);
 	float s = sin(amount*p[axis1]);
@@ -1353,10 +1615,10 @@ std::vector<std::string> worldObjectDomainModifierTypes = {
 	"Look At Camera",
 };
 */
-void map_the_domain_modifier(inout vec3 p, int modifierIndex){
+void map_the_domain_modifier_type(inout vec3 p, int modifierIndex, int type){
 
 
-	switch(worldObjectsData.domainModifiers[modifierIndex].type){
+	switch(type){
 		case 1:
 			p -= worldObjectsData.domainModifiers[modifierIndex].data1.xyz;
 			break;
@@ -1472,6 +1734,124 @@ void map_the_domain_modifier(inout vec3 p, int modifierIndex){
 	}
 }
 
+void map_the_domain_modifier(inout vec3 p, int modifierIndex){
+	map_the_domain_modifier_type(p, modifierIndex, worldObjectsData.domainModifiers[modifierIndex].type);
+}
+
+// Helpers that apply the linear part of a domain modifier to the Jacobian rows
+void scaleRow(inout mat3 J, int row, float s){
+	J[0][row] *= s;
+	J[1][row] *= s;
+	J[2][row] *= s;
+}
+
+void swapRows(inout mat3 J, int a, int b){
+	for(int k = 0; k < 3; k++){
+		float t = J[k][a];
+		J[k][a] = J[k][b];
+		J[k][b] = t;
+	}
+}
+
+void rotateRows(inout mat3 J, int a, int b, float angle){
+	for(int k = 0; k < 3; k++){
+		vec2 v = vec2(J[k][a], J[k][b]);
+		pR(v, angle);
+		J[k][a] = v.x;
+		J[k][b] = v.y;
+	}
+}
+
+void pRJ(inout vec3 p, inout mat3 J, int a, int b, float angle){
+	vec2 v = vec2(p[a], p[b]);
+	pR(v, angle);
+	p[a] = v.x;
+	p[b] = v.y;
+	rotateRows(J, a, b, angle);
+}
+
+void pModMirror1J(inout vec3 p, inout mat3 J, int a, float size){
+	float c = pModMirror1(p[a], size);
+	scaleRow(J, a, mod(c, 2.0)*2 - 1);
+}
+
+void pModPolarJ(inout vec3 p, inout mat3 J, int a, int b, float repetitions){
+	vec2 v = vec2(p[a], p[b]);
+	float before = atan(v.y, v.x);
+	pModPolar(v, repetitions);
+	rotateRows(J, a, b, before - atan(v.y, v.x));
+	p[a] = v.x;
+	p[b] = v.y;
+}
+
+void pMirrorOctantJ(inout vec3 p, inout mat3 J, int a, int b, vec2 dist){
+	vec2 v = vec2(p[a], p[b]);
+	vec2 mirrored = abs(v) - dist;
+	scaleRow(J, a, sgn(v.x));
+	scaleRow(J, b, sgn(v.y));
+	if (mirrored.y > mirrored.x) swapRows(J, a, b);
+	pMirrorOctant(v, dist);
+	p[a] = v.x;
+	p[b] = v.y;
+}
+
+// map_the_domain_modifier that also carries J = d(local point)/d(world point) along,
+// exact is cleared for the modifiers that are not piecewise affine (twist, bend, wiggles, moving rotations, look at)
+void map_the_domain_modifier_grad(inout vec3 p, inout mat3 J, int modifierIndex, inout bool exact){
+	vec4 data1 = worldObjectsData.domainModifiers[modifierIndex].data1;
+	vec4 data2 = worldObjectsData.domainModifiers[modifierIndex].data2;
+
+	switch(worldObjectsData.domainModifiers[modifierIndex].type){
+		case 0:
+			break;
+		case 1:
+			p -= data1.xyz;
+			break;
+		case 2:
+			if (data1.x != 0){	p.x /= data1.x; scaleRow(J, 0, 1.0 / data1.x); }
+			if (data1.y != 0){	p.y /= data1.y; scaleRow(J, 1, 1.0 / data1.y); }
+			if (data1.z != 0){	p.z /= data1.z; scaleRow(J, 2, 1.0 / data1.z); }
+			break;
+		case 3:
+			if (data1.x != 0)	pRJ(p, J, 1, 2, data1.x);
+			if (data1.y != 0)	pRJ(p, J, 0, 2, data1.y);
+			if (data1.z != 0)	pRJ(p, J, 0, 1, data1.z);
+			break;
+		case 4:
+			if (dot(p, data1.xyz) + data1.w < 0){
+				J[0] -= 2.0 * dot(J[0], data1.xyz) * data1.xyz;
+				J[1] -= 2.0 * dot(J[1], data1.xyz) * data1.xyz;
+				J[2] -= 2.0 * dot(J[2], data1.xyz) * data1.xyz;
+			}
+			pReflect(p, data1.xyz, data1.w);
+			break;
+		case 5:
+		case 7:
+		case 8:
+			// Repeats only shift the point
+			map_the_domain_modifier(p, modifierIndex);
+			break;
+		case 6:
+			if (data1.x != 0)	pModMirror1J(p, J, 0, data1.x);
+			if (data1.y != 0)	pModMirror1J(p, J, 1, data1.y);
+			if (data1.z != 0)	pModMirror1J(p, J, 2, data1.z);
+			break;
+		case 9:
+			if (data1.x != 0)	pModPolarJ(p, J, 1, 2, data1.x);
+			if (data1.y != 0)	pModPolarJ(p, J, 0, 2, data1.y);
+			if (data1.z != 0)	pModPolarJ(p, J, 1, 0, data1.z);
+			break;
+		case 10:
+			if (data1.x != 0)	pMirrorOctantJ(p, J, 1, 2, vec2(data1.x, data2.x));
+			if (data1.y != 0)	pMirrorOctantJ(p, J, 0, 2, vec2(data1.y, data2.y));
+			if (data1.z != 0)	pMirrorOctantJ(p, J, 0, 1, vec2(data1.z, data2.z));
+			break;
+		default:
+			exact = false;
+			break;
+	}
+}
+
 vec4 triPlanar(int textureIndex, vec3 p, vec3 blend, vec4 offset, int objectType){
 	p -= offset.xyz;
 	p.y = -p.y;
@@ -1480,60 +1860,50 @@ vec4 triPlanar(int textureIndex, vec3 p, vec3 blend, vec4 offset, int objectType
 			texture(texSampler[textureIndex], p.zy * 0.5 + 0.5) * blend.x);
 }
 
-vec4 getTextureValForCoordType(int textureIndex, vec3 worldPos, vec3 normal, vec3 size, vec3 scale, vec4 offset, int objectType){
-	vec3 p, blend;
-	blend = abs(normal);
+vec3 textureScaleForType(vec3 size, vec3 scale, int objectType){
 	switch(objectType){
-	case 1: // "Plane"
-		p = worldPos / scale;
-		break;
 	case 2: // "Sphere"
-		p = worldPos / (scale*size.x);
-		blend = pow(blend, vec3(5.0));
-		blend /= blend.x + blend.y + blend.z;
-		break;
+		return scale*size.x;
 	case 3: // "Box"
-		p = worldPos / (scale*size);
-		break;
+	case 10: // "Circle"
+	case 11: // "Disc"
+		return scale*size;
 	case 4: // "Box2"
-		p = worldPos / (scale*size.xyy);
-		break;
-	case 5: // "Corner"
-		p = worldPos / (scale);
-		break;
+		return scale*size.xyy;
+	case 7: // "Cylinder"
+	case 8: // "Capsule"
+	case 12: // "Hexagon Circumcircle"
+	case 13: // "Hexagon Incircle"
+	case 14: // "Cone"
+	case 15: // "Wiggle Sphere Move"
+		return scale*size.xyx;
+	case 9: // "Torus"
+		return scale*size.yxy;
+	}
+	return scale; // "Plane", "Corner", "Wiggle Sphere", "Wiggle Plane Move"
+}
+
+vec3 textureBlendForType(vec3 normal, int objectType){
+	vec3 blend = abs(normal);
+	switch(objectType){
+	case 2: // "Sphere"
 	case 6: // "Wiggle Sphere"
-		p = worldPos / scale;
-		blend = pow(blend, vec3(5.0));
-		blend /= blend.x + blend.y + blend.z;
-		break;
 	case 7: // "Cylinder"
 	case 8: // "Capsule"
-		p = worldPos / (scale*size.xyx);
-		blend = pow(blend, vec3(5.0));
-		blend /= blend.x + blend.y + blend.z;
-		break;
 	case 9: // "Torus"
-		p = worldPos / (scale*size.yxy);
-		blend = pow(blend, vec3(5.0));
-		blend /= blend.x + blend.y + blend.z;
-		break;
-	case 10: // "Circle"
-	case 11: // "Disc"
-		p = worldPos / (scale*size);
-		break;
 	case 12: // "Hexagon Circumcircle"
 	case 13: // "Hexagon Incircle"
 	case 14: // "Cone"
 	case 15: // "Wiggle Sphere Move"
-		p = worldPos / (scale*size.xyx);
 		blend = pow(blend, vec3(5.0));
 		blend /= blend.x + blend.y + blend.z;
 		break;
-	case 16: // "Wiggle Plane Move"
-		p = worldPos / scale;
-		break;
 	}
-	return triPlanar(textureIndex, p, blend, offset, objectType);
+	return blend;
+}
+
+vec4 getTextureValForCoordType(int textureIndex, vec3 worldPos, vec3 normal, vec3 size, vec3 scale, vec4 offset, int objectType){
+	return triPlanar(textureIndex, worldPos / textureScaleForType(size, scale, objectType), textureBlendForType(normal, objectType), offset, objectType);
 }
 
 vec4 sampleSkybox(vec3 rayDirection, int textureIndex) {
@@ -1556,8 +1926,13 @@ vec4 sampleSkybox(vec3 rayDirection, int textureIndex) {
     vec2 uvL = vec2(uL, v);
     vec2 uvR = vec2(uR, v);
 
+#ifdef COMPUTE_BACKEND
+    // No screen space derivatives in a compute shader, the skybox is read from its top level
+    return textureLod(texSampler[textureIndex], uvL, 0.0);
+#else
     // Fetch from texture using textureGrad to avoid mipmapping artifacts
     return textureGrad(texSampler[textureIndex], uvL, dFdx(uvR), dFdy(uvR));
+#endif
 }
 
 vec4 getTextureValForType(int textureIndex, vec3 worldPos, vec3 normal, vec3 size, vec3 scale, vec4 offset, int objectType, vec2 uv, vec3 rayDir, int orientationType){
@@ -1582,6 +1957,135 @@ float bumpMapping(int textureIndex, vec3 p, vec3 n, float dist, vec3 size, vec3
 	return bump;
 }
 
+// Normal bump mode, bends the shading normal with the precomputed derivative maps instead of displacing the distance.
+// Uses the same projections as triPlanar, the height field is camData.data3.y * h to match bumpMapping.
+vec3 bumpNormal(int textureIndex, vec3 p, vec3 n, vec3 shadeNormal, vec3 size, vec3 scale, vec4 offset, int objectType){
+	vec3 k = textureScaleForType(size, scale, objectType);
+	vec3 blend = textureBlendForType(normalize(n), objectType);
+	vec3 q = p / k - offset.xyz;
+	q.y = -q.y;
+
+	vec2 texSize = vec2(textureSize(bumpSampler[textureIndex], 0));
+	vec2 dz = texture(bumpSampler[textureIndex], q.xy * 0.5 + 0.5).rg * texSize;
+	vec2 dy = texture(bumpSampler[textureIndex], q.xz * 0.5 + 0.5).rg * texSize;
+	vec2 dx = texture(bumpSampler[textureIndex], q.zy * 0.5 + 0.5).rg * texSize;
+
+	vec3 gradient = blend.z * vec3(dz.x / k.x, -dz.y / k.y, 0.0) +
+					blend.y * vec3(dy.x / k.x, 0.0, dy.y / k.z) +
+					blend.x * vec3(0.0, -dx.y / k.y, dx.x / k.z);
+	gradient *= 0.5 * camData.data3.y;
+
+	return normalize(shadeNormal - (gradient - dot(gradient, shadeNormal) * shadeNormal));
+}
+
+// Set while marching shadow rays, they skip the bump displacement and its texture reads
+bool shadowPass = false;
+
+// Object distance as seen by the march loop. Bump displacement only applies inside the camData.data3.z band,
+// so the object normal it needs for the triplanar blend is only computed there.
+float map_the_object_displaced_type(vec3 p, vec3 worldPos, int objectIndex, int type){
+	float dist = map_the_object_type(p, objectIndex, type);
+	if(!shadowPass && worldObjectsData.objects[objectIndex].int3 != 0 && worldObjectsData.objects[objectIndex].int5 == 0 && dist < camData.data3.z){
+		vec3 bumpPos = mix(p, worldPos, worldObjectsData.objects[objectIndex].int4);
+		vec3 normal = calculate_normal_object(bumpPos, objectIndex, dist);
+		dist += bumpMapping(worldObjectsData.objects[objectIndex].int3, bumpPos, normal, dist, worldObjectsData.objects[objectIndex].size, worldObjectsData.objects[objectIndex].data1.rgb, worldObjectsData.objects[objectIndex].data2, worldObjectsData.objects[objectIndex].type);
+	}
+	return dist;
+}
+
+float map_the_object_displaced(vec3 p, vec3 worldPos, int objectIndex){
+	return map_the_object_displaced_type(p, worldPos, objectIndex, worldObjectsData.objects[objectIndex].type);
+}
+
+#ifdef SCENE_SPECIALIZED
+// Straight-line version of map_the_index_dist for every index, written by VulkanRenderer::generateSceneShader
+#include "scene.glsl"
+#endif
+
+// Distance-only evaluator used by the march loops, fills dist, index, object and hitPos but not normal
+PixelInfo map_the_index_dist(vec3 p, int i, int skipIndex){
+    PixelInfo result;
+    result.dist = camData.max_dist;
+    result.index = i;
+    result.object = -1;
+    result.hitPos = p;
+	result.normal = vec3(0.0);
+    
+    if(i == skipIndex) return result;
+
+#ifdef SCENE_SPECIALIZED
+	return scene_index_dist(p, i);
+#endif
+
+    float cur_dist = 0.0;
+    int cur_object = -1;
+
+    int cur_type_to_check = worldObjectsData.indices[i].type;
+    int cur_index_to_check = worldObjectsData.indices[i].index;
+    int distBufferSize = 0;
+
+    int stop_crash = 0;
+
+    float distBuffer[CHAIN_STACK_SIZE];
+    int modifierBuffer[CHAIN_STACK_SIZE];
+
+    while(stop_crash < OBJECT_COUNT_MAX){
+        if(cur_type_to_check == 1){
+            stop_crash = OBJECT_COUNT_MAX;
+            cur_dist = map_the_object_displaced(p, result.hitPos, cur_index_to_check);
+            cur_object = cur_index_to_check;
+            p -= worldObjectsData.objects[cur_index_to_check].center;
+        }
+        else if(cur_type_to_check == 2){
+            stop_crash++;
+            distBuffer[distBufferSize] = map_the_object_displaced(p, result.hitPos, worldObjectsData.combineModifiers[cur_index_to_check].index2);
+            if(worldObjectsData.combineModifiers[cur_index_to_check].type == 21){
+                if(distBuffer[distBufferSize] > worldObjectsData.combineModifiers[cur_index_to_check].data1.x){
+                    cur_dist = distBuffer[distBufferSize];
+                    cur_object = worldObjectsData.combineModifiers[cur_index_to_check].index1;
+                    stop_crash = OBJECT_COUNT_MAX;
+                    break;
+                }
+                else{
+                    cur_type_to_check = worldObjectsData.combineModifiers[cur_index_to_check].index1Type;
+                    cur_index_to_check = worldObjectsData.combineModifiers[cur_index_to_check].index1;
+                    stop_crash++;
+                }
+                continue;
+            }
+            modifierBuffer[distBufferSize] = cur_index_to_check;
+            distBufferSize++;
+
+            cur_type_to_check = worldObjectsData.combineModifiers[cur_index_to_check].index1Type;
+            cur_index_to_check = worldObjectsData.combineModifiers[cur_index_to_check].index1;
+
+        }
+        else if(cur_type_to_check == 3){
+            stop_crash++;
+            map_the_domain_modifier(p, cur_index_to_check);
+            cur_dist = 1.0;
+            cur_type_to_check = worldObjectsData.domainModifiers[cur_index_to_check].index1Type;
+            cur_index_to_check = worldObjectsData.domainModifiers[cur_index_to_check].index1;
+        }
+        else{
+            cur_dist = camData.max_dist;
+            stop_crash = OBJECT_COUNT_MAX;
+        }
+    }
+
+    while(distBufferSize > 0){
+        distBufferSize--;
+        PixelInfo temp = map_the_combine_modifier(worldObjectsData.combineModifiers[modifierBuffer[distBufferSize]].type, cur_dist, distBuffer[distBufferSize], cur_object, worldObjectsData.combineModifiers[modifierBuffer[distBufferSize]].index2, vec3(0.0), vec3(0.0), worldObjectsData.combineModifiers[modifierBuffer[distBufferSize]].data1);
+        cur_dist = temp.dist;
+        cur_object = temp.object;
+    }
+	result.dist = cur_dist;
+	result.object = cur_object;
+	result.hitPos = p;
+    return result;
+}
+
+// Full evaluator with object normals, only run once at an accepted hit
 PixelInfo map_the_index(vec3 p, int i, int skipIndex){
     PixelInfo result;
     result.dist = camData.max_dist;
@@ -1602,16 +2106,16 @@ PixelInfo map_the_index(vec3 p, int i, int skipIndex){
 
     int stop_crash = 0;
 
-    float distBuffer[OBJECT_COUNT_MAX];
-    int modifierBuffer[OBJECT_COUNT_MAX];
-	vec3 normalBuffer[OBJECT_COUNT_MAX];
+    float distBuffer[CHAIN_STACK_SIZE];
+    int modifierBuffer[CHAIN_STACK_SIZE];
+	vec3 normalBuffer[CHAIN_STACK_SIZE];
 
     while(stop_crash < OBJECT_COUNT_MAX){
         if(cur_type_to_check == 1){
             stop_crash = OBJECT_COUNT_MAX;
             cur_dist = map_the_object(p, cur_index_to_check);
 			cur_normal = calculate_normal_object(mix(p, result.hitPos, worldObjectsData.objects[cur_index_to_check].int4), cur_index_to_check, cur_dist);
-            if(worldObjectsData.objects[cur_index_to_check].int3 != 0){
+            if(worldObjectsData.objects[cur_index_to_check].int3 != 0 && worldObjectsData.objects[cur_index_to_check].int5 == 0){
 				cur_dist += bumpMapping(worldObjectsData.objects[cur_index_to_check].int3, mix(p, result.hitPos, worldObjectsData.objects[cur_index_to_check].int4), cur_normal, cur_dist, worldObjectsData.objects[cur_index_to_check].size, worldObjectsData.objects[cur_index_to_check].data1.rgb, worldObjectsData.objects[cur_index_to_check].data2, worldObjectsData.objects[cur_index_to_check].type);
             }
             cur_object = cur_index_to_check;
@@ -1622,7 +2126,7 @@ PixelInfo map_the_index(vec3 p, int i, int skipIndex){
             int index2 = worldObjectsData.combineModifiers[cur_index_to_check].index2;
             distBuffer[distBufferSize] = map_the_object(p, index2);
             normalBuffer[distBufferSize] = calculate_normal_object(mix(p, result.hitPos, worldObjectsData.objects[index2].int4), index2, distBuffer[distBufferSize]);
-            if(worldObjectsData.objects[index2].int3 != 0){
+            if(worldObjectsData.objects[index2].int3 != 0 && worldObjectsData.objects[index2].int5 == 0){
                 distBuffer[distBufferSize] += bumpMapping(worldObjectsData.objects[index2].int3, mix(p, result.hitPos, worldObjectsData.objects[cur_index_to_check].int4), normalBuffer[distBufferSize], distBuffer[distBufferSize], worldObjectsData.objects[index2].size, worldObjectsData.objects[index2].data1.rgb, worldObjectsData.objects[index2].data2, worldObjectsData.objects[index2].type);
             }
             if(worldObjectsData.combineModifiers[cur_index_to_check].type == 21){
@@ -1673,25 +2177,114 @@ PixelInfo map_the_index(vec3 p, int i, int skipIndex){
     return result;
 }
 
+// Distance and world space gradient of one object, bump displacement has no analytic gradient
+float map_the_object_dual(vec3 p, mat3 J, int objectIndex, out vec3 gradient, inout bool exact){
+	float dist = map_the_object(p, objectIndex);
+	bool objectExact;
+	gradient = transpose(J) * map_the_object_grad(p, objectIndex, objectExact);
+	exact = exact && objectExact && !(worldObjectsData.objects[objectIndex].int3 != 0 && worldObjectsData.objects[objectIndex].int5 == 0 && dist < camData.data3.z);
+	return dist;
+}
+
+// Dual number style walk of the index chain: every distance carries its world space gradient through
+// the domain modifier Jacobians and the combine modifier partials. Falls back to four taps of
+// map_the_index_dist when the chain contains something without an exact gradient.
 vec3 calculate_normal_index(in vec3 p, int i, int skipIndex, float totalDist){
-    // const vec3 small_step = vec3(max(camData.data4.z, camData.data4.z*totalDist), 0.0, 0.0);
-	vec3 small_step;
-	if(camData.data4.z <= 0.0){
-		 small_step= vec3(0.001, 0.0, 0.0);
+	bool exact = true;
+	vec3 q = p;
+	mat3 J = mat3(1.0);
+	float cur_dist = camData.max_dist;
+	vec3 cur_grad = vec3(0.0);
+
+	int cur_type_to_check = worldObjectsData.indices[i].type;
+	int cur_index_to_check = worldObjectsData.indices[i].index;
+	int distBufferSize = 0;
+
+	int stop_crash = 0;
+
+	float distBuffer[CHAIN_STACK_SIZE];
+	vec3 gradBuffer[CHAIN_STACK_SIZE];
+	int modifierBuffer[CHAIN_STACK_SIZE];
+
+	while(stop_crash < OBJECT_COUNT_MAX && exact){
+		if(cur_type_to_check == 1){
+			stop_crash = OBJECT_COUNT_MAX;
+			cur_dist = map_the_object_dual(q, J, cur_index_to_check, cur_grad, exact);
+		}
+		else if(cur_type_to_check == 2){
+			stop_crash++;
+			distBuffer[distBufferSize] = map_the_object_dual(q, J, worldObjectsData.combineModifiers[cur_index_to_check].index2, gradBuffer[distBufferSize], exact);
+			if(worldObjectsData.combineModifiers[cur_index_to_check].type == 21){
+				if(distBuffer[distBufferSize] > worldObjectsData.combineModifiers[cur_index_to_check].data1.x){
+					cur_dist = distBuffer[distBufferSize];
+					cur_grad = gradBuffer[distBufferSize];
+					stop_crash = OBJECT_COUNT_MAX;
+					break;
+				}
+				else{
+					cur_type_to_check = worldObjectsData.combineModifiers[cur_index_to_check].index1Type;
+					cur_index_to_check = worldObjectsData.combineModifiers[cur_index_to_check].index1;
+					stop_crash++;
+				}
+				continue;
+			}
+			modifierBuffer[distBufferSize] = cur_index_to_check;
+			distBufferSize++;
+
+			cur_type_to_check = worldObjectsData.combineModifiers[cur_index_to_check].index1Type;
+			cur_index_to_check = worldObjectsData.combineModifiers[cur_index_to_check].index1;
+		}
+		else if(cur_type_to_check == 3){
+			stop_crash++;
+			map_the_domain_modifier_grad(q, J, cur_index_to_check, exact);
+			cur_dist = 1.0;
+			cur_type_to_check = worldObjectsData.domainModifiers[cur_index_to_check].index1Type;
+			cur_index_to_check = worldObjectsData.domainModifiers[cur_index_to_check].index1;
+		}
+		else{
+			cur_dist = camData.max_dist;
+			stop_crash = OBJECT_COUNT_MAX;
+		}
 	}
-	else{
-		small_step = vec3(max(camData.data4.z, camData.data4.z*totalDist), 0.0, 0.0);
+
+	if(exact){
+		while(distBufferSize > 0){
+			distBufferSize--;
+			int type = worldObjectsData.combineModifiers[modifierBuffer[distBufferSize]].type;
+			vec4 data = worldObjectsData.combineModifiers[modifierBuffer[distBufferSize]].data1;
+			vec2 partials = map_the_combine_modifier_partials(type, cur_dist, distBuffer[distBufferSize], data);
+			cur_grad = partials.x * cur_grad + partials.y * gradBuffer[distBufferSize];
+			cur_dist = map_the_combine_modifier(type, cur_dist, distBuffer[distBufferSize], 0, 0, vec3(0.0), vec3(0.0), data).dist;
+		}
+		if(dot(cur_grad, cur_grad) > 0.0) return normalize(cur_grad);
 	}
 
-    float gradient_x = map_the_index(p + small_step.xyy, i, skipIndex).dist - map_the_index(p - small_step.xyy, i, skipIndex).dist;
-    float gradient_y = map_the_index(p + small_step.yxy, i, skipIndex).dist - map_the_index(p - small_step.yxy, i, skipIndex).dist;
-    float gradient_z = map_the_index(p + small_step.yyx, i, skipIndex).dist - map_the_index(p - small_step.yyx, i, skipIndex).dist;
+	float h = normal_step(totalDist);
+	const vec2 k = vec2(1.0, -1.0);
+	return normalize(k.xyy * map_the_index_dist(p + k.xyy * h, i, skipIndex).dist +
+					 k.yyx * map_the_index_dist(p + k.yyx * h, i, skipIndex).dist +
+					 k.yxy * map_the_index_dist(p + k.yxy * h, i, skipIndex).dist +
+					 k.xxx * map_the_index_dist(p + k.xxx * h, i, skipIndex).dist);
+}
+
+void map_the_world_index(in vec3 point, int i, int skipIndex, inout PixelInfo pOutput){
+	PixelInfo cur = map_the_index_dist(point, i, skipIndex);
 
-    vec3 normal = vec3(gradient_x, gradient_y, gradient_z);
+	if (cur.dist < pOutput.dist){
+		pOutput.dist = cur.dist;
+		pOutput.index = i;
+		pOutput.object = cur.object;
+		pOutput.hitPos = cur.hitPos;
+	}
+}
 
-    return normalize(normal);
+// Distance from p to a BVH node's box, 0 inside
+float bvh_node_dist(in vec3 p, int node){
+	vec3 d = max(worldBVH.nodes[node].boundsMin.xyz - p, p - worldBVH.nodes[node].boundsMax.xyz);
+	return length(max(d, vec3(0)));
 }
 
+// Distance-only, the normal and material of the closest index are fetched with map_the_index at the hit
 PixelInfo map_the_world_new(in vec3 point, int skipIndex){
     PixelInfo pOutput;
     pOutput.dist = 100000.0;
@@ -1700,20 +2293,37 @@ PixelInfo map_the_world_new(in vec3 point, int skipIndex){
     pOutput.hitPos = vec3(100000.0);
 	pOutput.normal = vec3(0.0);
 
-    for (int i = 0; i < worldObjectsData.num_indices; ++i)
+    for (int u = 0; u < worldBVH.num_unbounded; ++u)
     {
-        vec3 p = point;
-        PixelInfo cur = map_the_index(p, i, skipIndex);
-
-        if (cur.dist < pOutput.dist){
-            pOutput.dist = cur.dist;
-            pOutput.index = i;
-            pOutput.object = cur.object;
-            pOutput.hitPos = cur.hitPos;
-			pOutput.normal = cur.normal;
-        }
+        map_the_world_index(point, worldBVH.unbounded[u/4][u%4], skipIndex, pOutput);
     }
 
+	// Nearest child first, a subtree whose box is farther than the best distance so far can't hold a closer index.
+	// Inside an object the best distance is negative, a box the point is in (0) can still hold one it's deeper inside.
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	if (worldBVH.num_nodes > 0) stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		int node = stack[--stackSize];
+		if (bvh_node_dist(point, node) > max(pOutput.dist, 0.0)) continue;
+
+		if (worldBVH.nodes[node].index >= 0){
+			map_the_world_index(point, worldBVH.nodes[node].index, skipIndex, pOutput);
+			continue;
+		}
+
+		int nearChild = worldBVH.nodes[node].left;
+		int farChild = worldBVH.nodes[node].right;
+		if (bvh_node_dist(point, farChild) < bvh_node_dist(point, nearChild)){
+			nearChild = worldBVH.nodes[node].right;
+			farChild = worldBVH.nodes[node].left;
+		}
+		stack[stackSize++] = farChild;
+		stack[stackSize++] = nearChild;
+	}
+
     return pOutput;
 }
 /**/
@@ -1760,45 +2370,99 @@ vec3 rotateVec3ByYawPitchRoll(vec3 v, float yaw, float pitch, float roll) {
 }
 
 vec3 calculate_normal_world(in vec3 p, int skipIndex, float totalDist){
-    // const vec3 small_step = vec3(max(camData.data4.z, camData.data4.z*totalDist), 0.0, 0.0);
-	vec3 small_step;
-	if(camData.data4.z <= 0.0){
-		 small_step= vec3(0.001, 0.0, 0.0);
-	}
-	else{
-		small_step = vec3(max(camData.data4.z, camData.data4.z*totalDist), 0.0, 0.0);
+	float h = normal_step(totalDist);
+	const vec2 k = vec2(1.0, -1.0);
+	return normalize(k.xyy * map_the_world_new(p + k.xyy * h, skipIndex).dist +
+					 k.yyx * map_the_world_new(p + k.yyx * h, skipIndex).dist +
+					 k.yxy * map_the_world_new(p + k.yxy * h, skipIndex).dist +
+					 k.xxx * map_the_world_new(p + k.xxx * h, skipIndex).dist);
+}
+
+// Over-relaxed sphere tracing (camData.data2.x), steps are omega * dist. A step is only safe while the unbounding
+// spheres of the last two samples still overlap, when they don't there could be a surface in the gap so the march
+// goes back to a plain step from the last safe sample and stays unrelaxed for the rest of the ray. Landing inside
+// counts as failed too, a head on overshoot leaves the spheres just touching and the hit test would take the point
+// (omega - 1) * prev_dist under the surface.
+float relaxation_factor(){
+	return clamp(camData.data2.x, 1.0, 1.95);
+}
+
+bool relaxed_step_failed(float omega, float dist, float prev_dist, float step_length){
+	return omega > 1.0 && step_length > 0.0 && (dist < 0.0 || abs(dist) + abs(prev_dist) < step_length);
+}
+
+// Pulls a hit found within min_step onto the surface, camData.int1 iterations. A bracketed sign change is closed with
+// regula falsi, otherwise the remaining distance is stepped off since the sample is already next to the surface.
+float refine_hit(in vec3 ro, in vec3 rd, int skipIndex, float t_outside, float dist_outside, float t_hit, float dist_hit){
+	for (int i = 0; i < camData.int1; ++i){
+		if (dist_hit < 0.0 && dist_outside > 0.0){
+			float t = t_hit - dist_hit * (t_hit - t_outside) / (dist_hit - dist_outside);
+			float dist = map_the_world_new(ro + t * rd, skipIndex).dist;
+			if (dist < 0.0){
+				t_hit = t;
+				dist_hit = dist;
+			}
+			else{
+				t_outside = t;
+				dist_outside = dist;
+			}
+			if (abs(dist) < camData.min_step * 0.01) return t;
+		}
+		else{
+			t_outside = t_hit;
+			dist_outside = dist_hit;
+			t_hit += dist_hit;
+			dist_hit = map_the_world_new(ro + t_hit * rd, skipIndex).dist;
+			if (abs(dist_hit) < camData.min_step * 0.01) return t_hit;
+		}
 	}
-
-    float gradient_x = map_the_world_new(p + small_step.xyy, skipIndex).dist - map_the_world_new(p - small_step.xyy, skipIndex).dist;
-    float gradient_y = map_the_world_new(p + small_step.yxy, skipIndex).dist - map_the_world_new(p - small_step.yxy, skipIndex).dist;
-    float gradient_z = map_the_world_new(p + small_step.yyx, skipIndex).dist - map_the_world_new(p - small_step.yyx, skipIndex).dist;
-
-    vec3 normal = vec3(gradient_x, gradient_y, gradient_z);
-
-    return normalize(normal);
+	return t_hit;
 }
 
-vec3 ray_march_shadow(in vec3 ro, in vec3 rd, int skipIndex, int remainingSteps){
+// Shadow rays only read geometry (no bump displacement) and stop at the light. The closest miss along the way gives a
+// single pass penumbra estimate, sharpness * dist / travelled, so a ray grazing an occluder comes back partly lit.
+// A bump that pushes the surface in (camData.data3.y > 0) leaves the hit up to that far inside the geometry read
+// here, the ray only steps out of it until then. Running out of steps before the light counts as shadowed.
+vec3 ray_march_shadow(in vec3 ro, in vec3 rd, int skipIndex, int remainingSteps, float sharpness){
+	float light_dist = length(camData.light_pos - ro);
 	float total_distance_traveled = 0.0;
-	float minStep = camData.min_step * 10;
+	float light = 1.0;
+	float bump_depth = max(camData.data3.y, 0.0);
 
-    for (int i = remainingSteps; i < camData.num_steps; ++i)
+	float omega = relaxation_factor();
+	float prev_dist = 0.0;
+	float prev_t = 0.0;
+
+	shadowPass = true;
+    for (int i = remainingSteps; i < min(camData.num_steps, MAX_STEP_COUNT) && total_distance_traveled < light_dist; ++i)
     {
         vec3 current_position = ro + total_distance_traveled * rd;
-		float dist = length(current_position - camData.light_pos);
-		float cur_dist = length(current_position - ro);
 
-        PixelInfo closestInfo = map_the_world_new(current_position, skipIndex);
+        float dist = map_the_world_new(current_position, skipIndex).dist;
 
-		if (closestInfo.dist < camData.min_step && cur_dist > camData.min_step * 10) {
-			return vec3(0.0);
+		if (total_distance_traveled < bump_depth) {
+			total_distance_traveled += max(dist, camData.min_step);
+			prev_t = total_distance_traveled;
+			continue;
 		}
-        if (dist < camData.min_step) {
-			return vec3(1.0);
-        }
-		total_distance_traveled += min(closestInfo.dist, dist); // max(min(closestInfo.dist, dist), minStep);
+		if (relaxed_step_failed(omega, dist, prev_dist, total_distance_traveled - prev_t)) {
+			total_distance_traveled = prev_t + abs(prev_dist);
+			omega = 1.0;
+			continue;
+		}
+		if (dist < camData.min_step && total_distance_traveled > camData.min_step * 10) {
+			light = 0.0;
+			break;
+		}
+		light = min(light, sharpness * dist / max(total_distance_traveled, camData.min_step));
+		prev_t = total_distance_traveled;
+		prev_dist = dist;
+		total_distance_traveled += omega * dist;
     }
-    return vec3(0.0);
+	shadowPass = false;
+
+	if (total_distance_traveled < light_dist) return vec3(0.0);
+    return vec3(clamp(light, 0.0, 1.0));
 }
 	
 /*
@@ -1807,7 +2471,7 @@ vec3 ray_march_new2(in vec3 ro, in vec3 rd, int skipIndex, int remainingSteps)
     float total_distance_traveled = 0.0;
 	float minStep = camData.min_step * 10;
 
-    for (int i = remainingSteps; i < camData.num_steps; ++i)
+    for (int i = remainingSteps; i < min(camData.num_steps, MAX_STEP_COUNT); ++i)
     {
         vec3 current_position = ro + total_distance_traveled * rd;
 
@@ -1855,7 +2519,7 @@ vec3 ray_march_new2(in vec3 ro, in vec3 rd, int skipIndex, int remainingSteps)
     float total_distance_traveled = 0.0;
     
 
-    for (int i = remainingSteps; i < camData.num_steps; ++i)
+    for (int i = remainingSteps; i < min(camData.num_steps, MAX_STEP_COUNT); ++i)
     {
         vec3 current_position = ro + total_distance_traveled * rd;
 
@@ -1910,7 +2574,7 @@ vec3 ray_march_new(in vec3 ro, in vec3 rd)
 {
     float total_distance_traveled = 0.0;
     float minStep = camData.min_step*10;
-    for (int i = 0; i < camData.num_steps; ++i)
+    for (int i = 0; i < min(camData.num_steps, MAX_STEP_COUNT); ++i)
     {
         vec3 current_position = ro + total_distance_traveled * rd;
 
@@ -1982,133 +2646,539 @@ struct HitInfo{
 };
 */
 
-const int MAX_ITER_COUNT = 5;
-const int MAX_RAY_COUNT = 31; //pow(2, MAX_ITER_COUNT)-1;
+const int MARCH_OUT_OF_STEPS = 0;
+const int MARCH_HIT = 1;
+const int MARCH_MISSED = 2;
+
+// Sphere traces one ray from cur_dist, travelled is how far the ray tree went before this ray's origin. On a hit
+// cur_dist is the (refined) hit distance and closestInfo what was hit, out of steps it's how far the ray safely got,
+// steps is how many steps it took either way.
+int march_ray(in vec3 ro, in vec3 rd, int skipIndex, float travelled, inout float cur_dist, out PixelInfo closestInfo, out int steps){
+	float omega = relaxation_factor();
+	float prev_dist = 0.0;
+	float prev_t = cur_dist;
+	for (steps = 0; steps < min(camData.num_steps, MAX_STEP_COUNT); ++steps){
+		closestInfo = map_the_world_new(ro + cur_dist * rd, skipIndex);
+
+		if (relaxed_step_failed(omega, closestInfo.dist, prev_dist, cur_dist - prev_t)) {
+			cur_dist = prev_t + abs(prev_dist);
+			omega = 1.0;
+			continue;
+		}
+		if (closestInfo.dist < camData.min_step && cur_dist > camData.min_step * 10) {
+			if (camData.int1 > 0){
+				cur_dist = refine_hit(ro, rd, skipIndex, prev_t, prev_dist, cur_dist, closestInfo.dist);
+				closestInfo = map_the_world_new(ro + cur_dist * rd, skipIndex);
+			}
+			return MARCH_HIT;
+		}
+		prev_t = cur_dist;
+		prev_dist = closestInfo.dist;
+		cur_dist += omega * closestInfo.dist; // max(closestInfo.dist, minStep);
 
-vec3 ray_march_iter(in vec3 roIn, in vec3 rdIn, in vec2 uv){
-    float minStep = camData.min_step*10;
+		if (travelled + cur_dist > camData.max_dist) return MARCH_MISSED;
+	}
+	// The last relaxed step was never checked, the plain step before it is still outside everything
+	cur_dist = min(cur_dist, prev_t + max(prev_dist, 0.0));
+	return MARCH_OUT_OF_STEPS;
+}
+
+// Color of a hit lit by the light, without its shadow. The texture's alpha takes its share out of the object's
+// reflectivity and transparency and a normal-mapped bump replaces normal, both for the rays it spawns.
+vec3 light_hit(vec3 current_position, vec3 rd, int index, int skipIndex, vec2 uv, inout WorldObject current_object, inout vec3 normal, out float diffuse_intensity){
+	vec3 rayColor = vec3(1.0);
+	PixelInfo hitInfo = map_the_index(current_position, index, skipIndex);
+	vec3 direction_to_light = normalize(current_position - camData.light_pos);
+
+	if(current_object.textureIndex != 0){
+		vec4 color = getTextureValForType(current_object.textureIndex, mix(hitInfo.hitPos, current_position, current_object.int2), mix(hitInfo.normal, normal, current_object.int2), current_object.size, current_object.data1.rgb, current_object.data2, current_object.type, uv, rd, current_object.int2); // Change `hitInfo.hitPos` to `current_position` to swap from object space to world space for the texture
+		rayColor = color.rgb;
+		current_object.reflectivity *= 1 - color.a;
+		current_object.transparency *= 1 - color.a;
+	}
+	if(current_object.int3 != 0 && current_object.int5 == 1){
+		normal = bumpNormal(current_object.int3, mix(hitInfo.hitPos + current_object.center, current_position, current_object.int4), hitInfo.normal, normal, current_object.size, current_object.data1.rgb, current_object.data2, current_object.type);
+	}
+	if(current_object.color.x == -2.0){
+		rayColor *= rotateVec3ByYawPitchRoll(normal, camData.data1.x, camData.data1.y, camData.data1.z) * 0.5 + 0.5;
+	}
+	else{
+		rayColor *= current_object.color;
+	}
+	diffuse_intensity = max(0.0, dot(normal, -direction_to_light));
+	return rayColor * (1.0 - current_object.diffuse_intensity + diffuse_intensity * current_object.diffuse_intensity);
+}
+
+// What a hit's color is scaled by for its shadow, the shadow ray gets the steps the ray to the hit didn't use
+float hit_shadow(vec3 current_position, WorldObject current_object, float diffuse_intensity, int usedSteps){
+	// The renderer's preview tier turns shadows off
+	if(current_object.shadow_blur <= 0 || raymarch.shadowsOff != 0) return 1.0;
+
+	vec3 newRayDir = normalize(camData.light_pos - current_position);
+	vec3 newPos = current_position + newRayDir * 2.5 * camData.min_step;
+	// Facing away from the light is already in its own shadow
+	float shadow = diffuse_intensity > 0.0 ? ray_march_shadow(newPos, newRayDir, -1, usedSteps, current_object.shadow_blur * 16.0).x : 0.0;
+	return 1.0 - current_object.shadow_intensity + shadow * current_object.shadow_intensity;
+}
+
+// Rays are taken depth first from a small stack and add their color times their weight straight into the pixel,
+// so the state only grows with the ray depth. A hit keeps (1 - reflectivity) * (1 - transparency) of its weight,
+// the reflection gets reflectivity and the refraction (1 - reflectivity) * transparency, same as mixing the
+// children into the parent back to front. Only the root skips startDist, primaryDist is how far it went and
+// primaryObject what it hit, -1 for nothing.
+vec3 trace_ray_tree(RayTask root, in vec2 uv, float startDist, out float primaryDist, out int primaryObject){
 	int min_ray_depth = min(camData.ray_depth, MAX_ITER_COUNT);
+	primaryDist = camData.max_dist;
+	primaryObject = -1;
+
+	// Every level leaves at most one sibling behind, the deepest spawning level pushes two
+	RayTask rayStack[MAX_ITER_COUNT];
+	rayStack[0] = root;
+	int stackSize = 1;
+
+	vec3 finalColor = vec3(0.0);
+	while(stackSize > 0){
+		stackSize--;
+		RayTask ray = rayStack[stackSize];
+		vec3 rayColor = vec3(1.0);
+		float ownWeight = 1.0;
+		// Only the root starts past the empty space the cone prepass or the depth seed found
+		bool isRoot = ray.iterDepth == root.iterDepth;
+		float cur_dist = isRoot ? startDist : 0.0;
+		float baseDist = ray.totalDist - cur_dist;
+
+		PixelInfo closestInfo;
+		int steps;
+		int result = march_ray(ray.ro, ray.rd, ray.index, baseDist, cur_dist, closestInfo, steps);
+		if (result == MARCH_HIT){
+			ray.totalDist = baseDist + cur_dist;
+			vec3 current_position = ray.ro + cur_dist * ray.rd;
+			if (isRoot){
+				primaryDist = cur_dist;
+				primaryObject = closestInfo.object;
+			}
 
-	HitInfo[MAX_RAY_COUNT] rayInfo;
-	rayInfo[0].ro = roIn;
-	rayInfo[0].rd = rdIn;
-	rayInfo[0].totalDist = 0.0;
-	rayInfo[0].index = -1;
-	rayInfo[0].steps = 0;
-	rayInfo[0].influence = 1.0;
-	rayInfo[0].totalInfluence = 1.0;
-	rayInfo[0].iterDepth = 1;
-	rayInfo[0].color = vec3(1.0);
-	rayInfo[0].parent = -1;
-	int rayCount = 1;
-	for(int rayIndex = 0; rayIndex < rayCount; rayIndex++){
-		float cur_dist = 0.0;
-		for (int i = 0; i < camData.num_steps; ++i){	
-			vec3 current_position = rayInfo[rayIndex].ro + cur_dist * rayInfo[rayIndex].rd;
-
-			PixelInfo closestInfo = map_the_world_new(current_position, rayInfo[rayIndex].index);
-
-			if (closestInfo.dist < camData.min_step && cur_dist > camData.min_step * 10) {   
-				WorldObject current_object = worldObjectsData.objects[closestInfo.object];
-				vec3 normal = calculate_normal_world(current_position, rayInfo[rayIndex].index, rayInfo[rayIndex].totalDist);
-				vec3 direction_to_light = normalize(current_position - camData.light_pos);
-
-				if(current_object.textureIndex != 0){
-					vec4 color = getTextureValForType(current_object.textureIndex, mix(closestInfo.hitPos, current_position, current_object.int2), mix(closestInfo.normal, normal, current_object.int2), current_object.size, current_object.data1.rgb, current_object.data2, current_object.type, uv, rayInfo[rayIndex].rd, current_object.int2); // Change `closestInfo.hitPos` to `current_position` to swap from object space to world space for the texture
-					rayInfo[rayIndex].color = color.rgb;
-					current_object.reflectivity *= 1 - color.a;
-					current_object.transparency *= 1 - color.a;
-				}
-				if(current_object.color.x == -2.0){
-					rayInfo[rayIndex].color *= rotateVec3ByYawPitchRoll(normal, camData.data1.x, camData.data1.y, camData.data1.z) * 0.5 + 0.5;
-				}
-				else{
-					rayInfo[rayIndex].color *= current_object.color;
-				}
-				float diffuse_intensity = max(0.0, dot(normal, -direction_to_light));
-				rayInfo[rayIndex].color *= (1.0 - current_object.diffuse_intensity + diffuse_intensity * current_object.diffuse_intensity);
-				if(rayInfo[rayIndex].iterDepth < min_ray_depth){
-					if (current_object.reflectivity > 0.0){ // * rayInfo[rayIndex].totalInfluence > 0.05){
-						vec3 newRayDir = reflect_ray(rayInfo[rayIndex].rd, normal);
-						vec3 newPos = current_position + newRayDir * 1.5 * camData.min_step;
-						rayInfo[rayCount].ro = newPos;
-						rayInfo[rayCount].rd = newRayDir;
-						rayInfo[rayCount].totalDist = rayInfo[rayIndex].totalDist;
-						rayInfo[rayCount].index = -1;
-						rayInfo[rayCount].steps = i;
-						rayInfo[rayCount].influence = current_object.reflectivity;
-						rayInfo[rayCount].totalInfluence *= current_object.reflectivity;
-						rayInfo[rayCount].iterDepth = rayInfo[rayIndex].iterDepth + 1;
-						rayInfo[rayCount].color = vec3(1.0);
-						rayInfo[rayCount].parent = rayIndex;
-						rayCount++;
-					}
-					if (current_object.transparency > 0.0){ // * rayInfo[rayIndex].totalInfluence > 0.025){
-						rayInfo[rayCount].ro = current_position;
-						rayInfo[rayCount].rd = refract(rayInfo[rayIndex].rd, normal, current_object.refractive_index);
-						rayInfo[rayCount].totalDist = rayInfo[rayIndex].totalDist;
-						rayInfo[rayCount].index = closestInfo.index;
-						rayInfo[rayCount].steps = i;
-						rayInfo[rayCount].influence = current_object.transparency;
-						rayInfo[rayCount].totalInfluence *= current_object.transparency;
-						rayInfo[rayCount].iterDepth = rayInfo[rayIndex].iterDepth + 1;
-						rayInfo[rayCount].color = vec3(1.0);
-						rayInfo[rayCount].parent = rayIndex;
-						rayCount++;
-					}
+			WorldObject current_object = worldObjectsData.objects[closestInfo.object];
+			vec3 normal = calculate_normal_index(current_position, closestInfo.index, ray.index, ray.totalDist);
+			float diffuse_intensity;
+			rayColor = light_hit(current_position, ray.rd, closestInfo.index, ray.index, uv, current_object, normal, diffuse_intensity);
+
+			if(ray.iterDepth < min_ray_depth){
+				if (current_object.reflectivity > 0.0){
+					vec3 newRayDir = reflect_ray(ray.rd, normal);
+					vec3 newPos = current_position + newRayDir * 1.5 * camData.min_step;
+					rayStack[stackSize++] = RayTask(newPos, newRayDir, ray.weight * ownWeight * current_object.reflectivity, ray.totalDist, -1, ray.iterDepth + 1);
+					ownWeight *= 1.0 - current_object.reflectivity;
 				}
-
-				if(current_object.shadow_blur > 0){
-					vec3 newRayDir = normalize(camData.light_pos - current_position);
-					vec3 newPos = current_position + newRayDir * 2.5 * camData.min_step;
-					vec3 shadow = ray_march_shadow(newPos, newRayDir, -1, i);
-					rayInfo[rayIndex].color = rayInfo[rayIndex].color * (1.0 - current_object.shadow_intensity) + rayInfo[rayIndex].color * shadow * current_object.shadow_intensity;
+				if (current_object.transparency > 0.0){
+					rayStack[stackSize++] = RayTask(current_position, refract(ray.rd, normal, current_object.refractive_index), ray.weight * ownWeight * current_object.transparency, ray.totalDist, closestInfo.index, ray.iterDepth + 1);
+					ownWeight *= 1.0 - current_object.transparency;
 				}
-				break;
-			}
-			rayInfo[rayIndex].totalDist += closestInfo.dist; // max(closestInfo.dist, minStep);
-			cur_dist += closestInfo.dist;
-			
-			if (rayInfo[rayIndex].totalDist > camData.max_dist)
-			{
-				rayInfo[rayIndex].color =  sampleSkybox(rayInfo[rayIndex].rd, 0).rgb;
-				break;
 			}
+
+			rayColor *= hit_shadow(current_position, current_object, diffuse_intensity, steps);
 		}
+		else if (result == MARCH_MISSED){
+			rayColor = sampleSkybox(ray.rd, 0).rgb;
+		}
+		// Not the sky, the depth seed can still start this pixel from as far as it got
+		else if (isRoot){
+			primaryDist = cur_dist;
+		}
+		finalColor += ray.weight * ownWeight * rayColor;
 	}
-	
-	for(int i = rayCount-1; i >0 ; i--){
-		rayInfo[rayInfo[i].parent].color = mix(rayInfo[rayInfo[i].parent].color, rayInfo[i].color, rayInfo[i].influence);
-	}
-	//finalColor = vec3(rayCount/5);
-	return rayInfo[0].color;
+	return finalColor;
 }
 
-void main() {
+vec3 ray_march_iter(in vec3 roIn, in vec3 rdIn, in vec2 uv, float startDist, out float primaryDist, out int primaryObject){
+	return trace_ray_tree(RayTask(roIn, rdIn, 1.0, startDist, -1, 1), uv, startDist, primaryDist, primaryObject);
+}
 
+// Direction of the ray through a pixel for a camera with yaw/pitch/roll rot and fov in degrees
+vec3 camera_ray_dir(vec2 fragCoord, vec3 rot, float fovDegrees){
     float aspect = camData.resolution.x / camData.resolution.y;
     
     // Calculate UV coordinates in the range of [-1, 1] and correct for aspect ratio
-    vec2 uv = (gl_FragCoord.xy / camData.resolution.xy) * 2.0 - 1.0;
+    vec2 uv = (fragCoord / camData.resolution.xy) * 2.0 - 1.0;
     uv.x *= aspect;
 	uv.y *= -1.0;
     
     // Define field of view (in radians)
-    float fov = radians(camData.data4.x); // Example 90-degree FOV
+    float fov = radians(fovDegrees);
     float z = 1.0 / tan(fov * 0.5); // Adjust based on FOV
 
     // Ray direction for the current pixel
     vec3 rd = normalize(vec3(uv.xy, z));
     
     // Rotate the ray direction based on camera orientation
-    rd = rotateVec3ByYawPitchRoll(rd, camData.camera_rot.x, camData.camera_rot.y, camData.camera_rot.z);
+    return rotateVec3ByYawPitchRoll(rd, rot.x, rot.y, rot.z);
+}
+
+// Direction of the camera ray through a pixel, fragCoord in full resolution pixels
+vec3 camera_ray_dir(vec2 fragCoord){
+    return camera_ray_dir(fragCoord, camData.camera_rot, camData.data4.x);
+}
+
+#ifdef CONE_PREPASS
+// Marches a cone around the tile's center ray. Every ray of the tile is within t * spread of the center ray at t, so
+// a step of (dist - t * spread) / (1 + spread) keeps the whole cone outside of the geometry. Stops as soon as the
+// cone touches something, the distance so far is then a safe start for every pixel in the tile.
+float cone_march(in vec3 ro, in vec3 rd, float spread){
+	float t = 0.0;
+	for (int i = 0; i < min(camData.num_steps, MAX_STEP_COUNT); ++i){
+		float clearance = map_the_world_new(ro + t * rd, -1).dist - t * spread;
+		if (clearance < camData.min_step * 10) break;
+		t += clearance / (1.0 + spread);
+		if (t > camData.max_dist) break;
+	}
+	return min(t, camData.max_dist);
+}
+
+void main() {
+	// Pixel centers of the full resolution tile this texel covers
+	vec2 tileMin = floor(gl_FragCoord.xy) * CONE_TILE_SIZE + 0.5;
+	vec2 tileMax = tileMin + CONE_TILE_SIZE - 1.0;
+	vec3 rd = camera_ray_dir((tileMin + tileMax) * 0.5);
+
+	// Chord between the center ray and the farthest corner ray, the corners are the farthest pixels of the tile
+	float spread = max(max(length(camera_ray_dir(tileMin) - rd), length(camera_ray_dir(tileMax) - rd)),
+						max(length(camera_ray_dir(vec2(tileMin.x, tileMax.y)) - rd), length(camera_ray_dir(vec2(tileMax.x, tileMin.y)) - rd)));
+
+	outColor = vec4(cone_march(camData.camera_pos, rd, spread), 0.0, 0.0, 1.0);
+}
+#else
+#ifdef COMPUTE_BACKEND
+vec4 load_reprojection(ivec2 pixel, bool current) {
+    if ((raymarch.frameParity == 0) == current) return imageLoad(reprojectionImageA, pixel);
+    return imageLoad(reprojectionImageB, pixel);
+}
+
+void store_reprojection(ivec2 pixel, vec4 value) {
+    if (raymarch.frameParity == 0) imageStore(reprojectionImageA, pixel, value);
+    else imageStore(reprojectionImageB, pixel, value);
+}
+
+// Inverse of camera_ray_dir, where worldPos lands in full resolution pixels for a camera at pos. False when it's
+// behind that camera.
+bool project_to_camera(vec3 worldPos, vec3 pos, vec3 rot, float fovDegrees, out vec2 pixelPos) {
+    vec4 q = quatMult(quatMult(quatFromAxisAngle(vec3(0.0, 1.0, 0.0), rot.x),
+                               quatFromAxisAngle(vec3(1.0, 0.0, 0.0), rot.y)),
+                      quatFromAxisAngle(vec3(0.0, 0.0, 1.0), rot.z));
+    vec3 local = rotateByQuaternion(worldPos - pos, vec4(-q.xyz, q.w));
+    if (local.z <= 0.0) return false;
+
+    vec2 uv = local.xy / local.z / tan(radians(fovDegrees) * 0.5);
+    uv.x /= camData.resolution.x / camData.resolution.y;
+    uv.y *= -1.0;
+    pixelPos = (uv * 0.5 + 0.5) * camData.resolution;
+    return true;
+}
+
+// Depth seeding, moves the last frame's primary hit at this pixel into this frame's camera. The sky splats its
+// camData.max_dist too, only the pixels nothing lands near are left to start at 0.
+void splat_depth(ivec2 pixel) {
+    float depth = load_reprojection(pixel, false).a;
+    vec3 worldPos = raymarch.prevCameraPos.xyz + camera_ray_dir(vec2(pixel) + 0.5, raymarch.prevCameraRot.xyz, raymarch.prevCameraPos.w) * depth;
+
+    vec2 pixelPos;
+    if (!project_to_camera(worldPos, camData.camera_pos, camData.camera_rot, camData.data4.x, pixelPos)) return;
+    ivec2 target = ivec2(floor(pixelPos));
+    if (any(lessThan(target, ivec2(0))) || any(greaterThanEqual(target, ivec2(camData.resolution)))) return;
+
+    // Positive floats order the same as their bits
+    imageAtomicMin(depthSeedImage, target, floatBitsToUint(length(worldPos - camData.camera_pos)));
+}
+
+// Start of the primary ray going by the splats. The nearest splat within a pixel covers the holes a moving camera
+// leaves, and it's shrunk so being a bit off stays in front of the surface. One distance evaluation checks the start
+// isn't in or against something the splats don't know about, otherwise and where nothing landed it's 0.
+float seeded_start_dist(ivec2 pixel, vec3 ro, vec3 rd) {
+    ivec2 size = ivec2(camData.resolution);
+    uint nearest = 0xFFFFFFFFu;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            nearest = min(nearest, imageLoad(depthSeedImage, clamp(pixel + ivec2(x, y), ivec2(0), size - 1)).r);
+        }
+    }
+    if (nearest == 0xFFFFFFFFu) return 0.0;
+
+    float t = uintBitsToFloat(nearest) * 0.95 - camData.min_step * 10.0;
+    if (t <= 0.0 || map_the_world_new(ro + t * rd, -1).dist < camData.min_step) return 0.0;
+    return t;
+}
+#endif
+
+// Screen space texture coordinates of a pixel, [-1, 1] on y with x corrected for the aspect ratio
+vec2 screen_uv(vec2 fragCoord) {
+    float aspect = camData.resolution.x / camData.resolution.y;
+    
+    // Calculate UV coordinates in the range of [-1, 1] and correct for aspect ratio
+    vec2 uv = (fragCoord / camData.resolution.xy) * 2.0 - 1.0;
+    uv.x *= aspect;
+	uv.y *= -1.0;
+    return uv;
+}
+
+// How far the camera ray can skip ahead, 0 when the prepass and the depth seed are off
+float primary_start_dist(vec2 fragCoord, vec3 ro, vec3 rd) {
+    float startDist = texelFetch(coneDepthSampler, ivec2(fragCoord) / CONE_TILE_SIZE, 0).r;
+#ifdef COMPUTE_BACKEND
+    if (raymarch.seedDepth != 0) {
+        startDist = max(startDist, seeded_start_dist(ivec2(fragCoord), ro, rd));
+    }
+#endif
+    return startDist;
+}
+
+// Color of one full resolution pixel, shared by the fragment and the compute backend. primaryDist is how far the
+// camera ray went before hitting something or running out of steps, camData.max_dist for the skybox, and
+// primaryObject the object it hit.
+vec3 shade_pixel(vec2 fragCoord, out float primaryDist, out int primaryObject) {
+    // Ray direction for the current pixel
+    vec3 rd = camera_ray_dir(fragCoord);
     
     // Set the ray origin as the camera position
     vec3 ro = camData.camera_pos;
 
     // Perform ray marching or tracing with the computed ray direction
-    vec3 shaded_color = ray_march_iter(ro, rd, uv);
+    return ray_march_iter(ro, rd, screen_uv(fragCoord), primary_start_dist(fragCoord, ro, rd), primaryDist, primaryObject);
+}
+
+#ifdef COMPUTE_BACKEND
+// Checkerboard, the pixels the first pass didn't shade. The nearest of the four shaded neighbors gives a hit point
+// that's projected into the last frame's camera, if the last frame's distance there agrees it's the same surface and
+// its color is used. Otherwise the pixel was hidden last frame and the neighbors are averaged instead. object is the
+// one the nearest neighbor hit.
+vec4 reconstruct_pixel(ivec2 pixel, out int object) {
+    ivec2 size = ivec2(camData.resolution);
+    const ivec2 offsets[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+
+    vec3 spatial = vec3(0.0);
+    float depth = camData.max_dist;
+    object = -1;
+    int count = 0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 neighbor = pixel + offsets[i];
+        if (any(lessThan(neighbor, ivec2(0))) || any(greaterThanEqual(neighbor, size))) continue;
+        vec4 shaded = load_reprojection(neighbor, true);
+        spatial += shaded.rgb;
+        if (shaded.a < depth) {
+            depth = shaded.a;
+            object = imageLoad(objectIdImage, neighbor).r;
+        }
+        count++;
+    }
+    spatial /= float(max(count, 1));
+
+    vec3 worldPos = camData.camera_pos + camera_ray_dir(vec2(pixel) + 0.5) * depth;
+
+    vec2 prevPixelPos;
+    if (!project_to_camera(worldPos, raymarch.prevCameraPos.xyz, raymarch.prevCameraRot.xyz, raymarch.prevCameraPos.w, prevPixelPos)) return vec4(spatial, depth);
+    ivec2 prevPixel = ivec2(floor(prevPixelPos));
+    if (any(lessThan(prevPixel, ivec2(0))) || any(greaterThanEqual(prevPixel, size))) return vec4(spatial, depth);
+
+    vec4 previous = load_reprojection(prevPixel, false);
+    float expected = length(worldPos - raymarch.prevCameraPos.xyz);
+    if (abs(previous.a - expected) > expected * 0.02 + camData.min_step * 10.0) return vec4(spatial, depth);
+    return vec4(previous.rgb, depth);
+}
+
+// Edge supersampling, after the primary pass. A pixel that hit a different object than one of its neighbors, or
+// whose primary hit distance or color is too far from theirs, is on an edge and gets four more rays on a rotated
+// grid. They're added to the history as four more samples, so accumulating keeps weighting every sample the same.
+// Pixels inside a surface or the sky return after a few loads.
+bool on_edge(ivec2 pixel, vec4 center, int centerObject) {
+    ivec2 size = ivec2(camData.resolution);
+    const ivec2 offsets[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+    for (int i = 0; i < 4; i++) {
+        ivec2 neighbor = pixel + offsets[i];
+        if (any(lessThan(neighbor, ivec2(0))) || any(greaterThanEqual(neighbor, size))) continue;
+        if (imageLoad(objectIdImage, neighbor).r != centerObject) return true;
+        vec4 other = load_reprojection(neighbor, true);
+        if (abs(other.a - center.a) > 0.05 * min(other.a, center.a) + camData.min_step * 10.0) return true;
+        vec3 diff = abs(other.rgb - center.rgb);
+        if (max(diff.r, max(diff.g, diff.b)) > 0.1) return true;
+    }
+    return false;
+}
+
+void supersample_edge(ivec2 pixel) {
+    vec4 center = load_reprojection(pixel, true);
+    if (!on_edge(pixel, center, imageLoad(objectIdImage, pixel).r)) return;
+
+    const vec2 offsets[4] = vec2[4](vec2(0.125, 0.375), vec2(-0.375, 0.125), vec2(-0.125, -0.375), vec2(0.375, -0.125));
+    vec4 history = imageLoad(historyImage, pixel);
+    vec3 color = history.rgb * history.a;
+    float primaryDist;
+    int primaryObject;
+    for (int i = 0; i < 4; i++) {
+        color += shade_pixel(vec2(pixel) + 0.5 + offsets[i], primaryDist, primaryObject);
+    }
+    color /= history.a + 4.0;
+
+    imageStore(historyImage, pixel, vec4(color, history.a + 4.0));
+    imageStore(raymarchImage, pixel, vec4(color, 1.0));
+}
+
+// Deferred shading, pass 0 split up so each pass only carries the registers of its own stage. The primary pass only
+// marches and writes the G-buffer, lighting textures and lights the hits, shadows marches the shadow rays and the
+// bounce pass traces the reflections and refractions and stores the pixel like pass 0.
+void gbuffer_pixel(ivec2 pixel) {
+    vec2 fragCoord = vec2(pixel) + 0.5 + raymarch.jitter;
+    vec3 rd = camera_ray_dir(fragCoord);
+    vec3 ro = camData.camera_pos;
+
+    float cur_dist = primary_start_dist(fragCoord, ro, rd);
+    PixelInfo closestInfo;
+    int steps;
+    int result = march_ray(ro, rd, -1, 0.0, cur_dist, closestInfo, steps);
+    if (result != MARCH_HIT) {
+        imageStore(gBufferImage, pixel, vec4(0.0, 0.0, 0.0, result == MARCH_MISSED ? camData.max_dist : cur_dist));
+        imageStore(gBufferIdImage, pixel, ivec4(-1, result == MARCH_MISSED ? -1 : -2, steps, 0));
+        return;
+    }
+    vec3 normal = calculate_normal_index(ro + cur_dist * rd, closestInfo.index, -1, cur_dist);
+    imageStore(gBufferImage, pixel, vec4(normal, cur_dist));
+    imageStore(gBufferIdImage, pixel, ivec4(closestInfo.index, closestInfo.object, steps, 0));
+}
+
+void light_pixel(ivec2 pixel) {
+    vec2 fragCoord = vec2(pixel) + 0.5 + raymarch.jitter;
+    vec3 rd = camera_ray_dir(fragCoord);
+    ivec4 ids = imageLoad(gBufferIdImage, pixel);
+    if (ids.y < 0) {
+        imageStore(lightingImage, pixel, vec4(ids.y == -1 ? sampleSkybox(rd, 0).rgb : vec3(1.0), 0.0));
+        return;
+    }
+
+    vec4 gBuffer = imageLoad(gBufferImage, pixel);
+    vec3 current_position = camData.camera_pos + gBuffer.w * rd;
+    vec3 normal = gBuffer.xyz;
+    WorldObject current_object = worldObjectsData.objects[ids.y];
+    float diffuse_intensity;
+    vec3 color = light_hit(current_position, rd, ids.x, -1, screen_uv(fragCoord), current_object, normal, diffuse_intensity);
+
+    // Same shares as trace_ray_tree gives the children of the primary ray
+    vec2 weights = vec2(0.0);
+    if (min(camData.ray_depth, MAX_ITER_COUNT) > 1) {
+        weights.x = max(current_object.reflectivity, 0.0);
+        weights.y = (1.0 - weights.x) * max(current_object.transparency, 0.0);
+    }
+    imageStore(gBufferImage, pixel, vec4(normal, gBuffer.w));
+    imageStore(gBufferIdImage, pixel, ivec4(ids.xyz, int(packHalf2x16(weights))));
+    imageStore(lightingImage, pixel, vec4(color * (1.0 - weights.x - weights.y), diffuse_intensity));
+}
+
+void shadow_pixel(ivec2 pixel) {
+    ivec4 ids = imageLoad(gBufferIdImage, pixel);
+    if (ids.y < 0) return;
+    WorldObject current_object = worldObjectsData.objects[ids.y];
+    if (current_object.shadow_blur <= 0 || raymarch.shadowsOff != 0) return;
+
+    vec3 rd = camera_ray_dir(vec2(pixel) + 0.5 + raymarch.jitter);
+    vec3 current_position = camData.camera_pos + imageLoad(gBufferImage, pixel).w * rd;
+    vec4 lighting = imageLoad(lightingImage, pixel);
+    lighting.rgb *= hit_shadow(current_position, current_object, lighting.a, ids.z);
+    imageStore(lightingImage, pixel, lighting);
+}
+
+vec3 bounce_pixel(ivec2 pixel, out float primaryDist, out int primaryObject) {
+    vec4 gBuffer = imageLoad(gBufferImage, pixel);
+    ivec4 ids = imageLoad(gBufferIdImage, pixel);
+    vec3 color = imageLoad(lightingImage, pixel).rgb;
+    primaryDist = gBuffer.w;
+    primaryObject = max(ids.y, -1);
+    if (ids.y < 0) return color;
+
+    vec2 weights = unpackHalf2x16(uint(ids.w));
+    vec2 fragCoord = vec2(pixel) + 0.5 + raymarch.jitter;
+    vec3 rd = camera_ray_dir(fragCoord);
+    vec3 current_position = camData.camera_pos + gBuffer.w * rd;
+    vec3 normal = gBuffer.xyz;
+    vec3 reflectDir = reflect_ray(rd, normal);
+
+    // One call site so the tree is only inlined once
+    for (int i = 0; i < 2; i++) {
+        RayTask child = i == 0
+            ? RayTask(current_position + reflectDir * 1.5 * camData.min_step, reflectDir, weights.x, gBuffer.w, -1, 2)
+            : RayTask(current_position, refract(rd, normal, worldObjectsData.objects[ids.y].refractive_index), weights.y, gBuffer.w, ids.x, 2);
+        if (child.weight <= 0.0) continue;
+        float childDist;
+        int childObject;
+        color += trace_ray_tree(child, screen_uv(fragCoord), 0.0, childDist, childObject);
+    }
+    return color;
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    // Each checkerboard pass covers every other pixel of a row, the half the second pass does is offset by one. The
+    // offset is always even so the pattern stays the same on screen.
+    if (raymarch.pass == 1 || raymarch.pass == 2) {
+        pixel.y += raymarch.tileOffset.y;
+        pixel.x = raymarch.tileOffset.x + pixel.x * 2 + ((pixel.y + raymarch.frameParity + raymarch.pass - 1) & 1);
+    }
+    else {
+        pixel += raymarch.tileOffset;
+    }
+    if (pixel.x >= int(camData.resolution.x) || pixel.y >= int(camData.resolution.y)) return;
+
+    if (raymarch.pass == 3) {
+        supersample_edge(pixel);
+        return;
+    }
+    if (raymarch.pass == 4) {
+        splat_depth(pixel);
+        return;
+    }
+    if (raymarch.pass == 5) {
+        gbuffer_pixel(pixel);
+        return;
+    }
+    if (raymarch.pass == 6) {
+        light_pixel(pixel);
+        return;
+    }
+    if (raymarch.pass == 7) {
+        shadow_pixel(pixel);
+        return;
+    }
+
+    vec3 color;
+    float primaryDist;
+    int primaryObject;
+    if (raymarch.pass == 2) {
+        vec4 reconstructed = reconstruct_pixel(pixel, primaryObject);
+        color = reconstructed.rgb;
+        primaryDist = reconstructed.a;
+    }
+    else if (raymarch.pass == 8) {
+        color = bounce_pixel(pixel, primaryDist, primaryObject);
+    }
+    else {
+        color = shade_pixel(vec2(pixel) + 0.5 + raymarch.jitter, primaryDist, primaryObject);
+    }
+
+    // Running average of every sample since the camera or the scene last changed, edge pixels have more of them
+    float samples = 0.0;
+    if (raymarch.sampleIndex > 0) {
+        vec4 history = imageLoad(historyImage, pixel);
+        samples = history.a;
+        color = mix(history.rgb, color, 1.0 / (samples + 1.0));
+    }
+    imageStore(historyImage, pixel, vec4(color, samples + 1.0));
+    store_reprojection(pixel, vec4(color, primaryDist));
+    imageStore(objectIdImage, pixel, ivec4(primaryObject));
+    imageStore(raymarchImage, pixel, vec4(color, 1.0));
+}
+#else
+void main() {
+    float primaryDist;
+    int primaryObject;
+    vec3 shaded_color = shade_pixel(gl_FragCoord.xy, primaryDist, primaryObject);
     
     // Output the final color
     outColor = vec4(shaded_color, 1.0);
-}
\ No newline at end of file
+}
+#endif
+#endif